@@ -1,74 +1,193 @@
-
-#include "aesgcm.hpp"
-#include "fixcapvec.hpp"
+#include "engine.hpp"
+#include "gcmkernel.hpp"
+#include "alignedbuf.hpp"
+#include "spsc.hpp"
 #include "overload.hpp"
-#include <openssl/evp.h>
-#include <iostream>
-#include <tuple>
+#include "probes.hpp"
+#include <algorithm>
 #include <cassert>
+#include <mutex>
+#include <thread>
+#include <sstream>
+#include <ctime>
+#include <unistd.h>
+
+std::size_t checked_buffer_size( const engine_options &opts )
+{
+  if ( opts.buffer_size < tag_size or opts.buffer_size > int_max_u - tag_size )
+  {
+    std::cerr <<
+      "error: buffer size out of range ("<< opts.buffer_size <<" bytes)\n";
+    throw see_stderr{};
+  }
+  return opts.buffer_size;
+}
+
+void log_result( const bool decrypt,
+  const std::uintmax_t size, const gcm_tag &tag )
+{
+  std::clog
+    << (not decrypt ? "ciphertext" : "plaintext") <<" size: "<< size <<" bytes\n"
+    << "tag: "<< hexed(tag) <<'\n'
+  ;
+}
+
+static std::int64_t thread_cpu_ns()
+{
+  timespec ts;
+  if ( ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) )
+    return 0;
+  return std::int64_t{ts.tv_sec}*1'000'000'000 + ts.tv_nsec;
+}
+
+engine_stats::timer::timer( stage *const s )
+  : s{s}
+{
+  if ( s )
+    wall0 = std::chrono::steady_clock::now(), cpu0 = thread_cpu_ns();
+}
+
+engine_stats::timer::~timer()
+{
+  if ( not s )
+    return;
+  s->wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - wall0 ).count();
+  s->cpu_ns += thread_cpu_ns() - cpu0;
+}
+
+void emit_stats( const engine_stats &s, const engine_options &opts,
+  const bool decrypt, const std::string_view in_path,
+  const std::optional<bool> authentic )
+{
+  if ( opts.stats_fd < 0 )
+    return;
+  const auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - s.start ).count();
+  const auto seconds = []( const std::int64_t ns ){ return double(ns)/1e9; };
+
+  std::ostringstream json;
+  json << "{\"op\": \""<< (decrypt ? "decrypt" : "encrypt") <<"\", ";
+  if ( not std::empty(in_path) )
+  {
+    json << "\"input\": \"";
+    for ( const auto c : in_path )
+      if ( c == '"' or c == '\\' )
+        json << '\\' << c;
+      else if ( static_cast<unsigned char>(c) < 0x20 )
+      {
+        constexpr auto hex = "0123456789abcdef";
+        json << "\\u00"<< hex[c >> 4] << hex[c & 15];
+      }
+      else
+        json << c;
+    json << "\", ";
+  }
+  json
+    << "\"backend\": \""<< s.backend <<"\", "
+    << "\"chunk_size\": "<< s.chunk_size <<", "
+    << "\"bytes_read\": "<< s.bytes_read <<", "
+    << "\"bytes_processed\": "<< s.bytes_processed <<", "
+    << "\"bytes_written\": "<< s.bytes_written <<", "
+    << "\"cipher_calls\": "<< s.cipher_calls <<", "
+    << "\"wall_seconds\": "<< seconds(wall_ns) <<", ";
+  for ( const auto &[name, st] : { std::pair{"read_wait", &s.read_wait},
+         std::pair{"crypto", &s.crypto}, std::pair{"write_wait", &s.write_wait} } )
+    json << "\""<< name <<"\": {\"wall_seconds\": "<< seconds(st->wall_ns)
+      <<", \"cpu_seconds\": "<< seconds(st->cpu_ns) <<"}, ";
+  json << "\"MBps\": "<<
+    (wall_ns ? double(s.bytes_processed) * 1e3 / double(wall_ns) : 0.);
+  if ( authentic )
+    json << ", \"authentic\": "<< (*authentic ? "true" : "false");
+  json << "}\n";
 
-template<typename Cont>
-constexpr auto capacity( const Cont &c )  { return c.capacity(); }
-template<typename T, std::size_t N>
-constexpr auto capacity( const T (&)[N] ) { return N; }
+  // A single write, so that lines from concurrent operations don't interleave
+  // (on a pipe, up to PIPE_BUF bytes); statistics are best effort, and never
+  // fail the operation.
+  const auto line = json.str();
+  if ( opts.stats_fd == STDERR_FILENO )
+    std::clog.flush();
+  [[maybe_unused]] const auto w =
+    ::write( opts.stats_fd, std::data(line), std::size(line) );
+}
+
+hash_tee::hash_tee( const std::vector<std::string> &specs )
+{
+  for ( const auto &spec : specs )
+  {
+    constexpr std::string_view prefix = "ciphertext:";
+    const auto of_ciphertext = spec.starts_with(prefix);
+    auto name = of_ciphertext ? spec.substr(std::size(prefix)) : spec;
+    const auto md = EVP_get_digestbyname( name.c_str() );
+    if ( not md )
+    {
+      std::cerr << "error: unknown hash: "<< name <<'\n';
+      throw see_stderr{};
+    }
+    evp_md_ctx ctx{ checked(EVP_MD_CTX_new,()) };
+    checked(EVP_DigestInit_ex,( ctx.get(), md, nullptr ));
+    digests.push_back( {std::move(name), of_ciphertext, std::move(ctx)} );
+  }
+}
 
-template<typename Cont>
-constexpr auto max_size( const Cont &c )  { return c.max_size(); }
-template<typename T, std::size_t N>
-constexpr auto max_size( const T (&)[N] ) { return N; }
+void hash_tee::update( const bool of_ciphertext,
+  const byte *const p, const std::size_t n )
+{
+  for ( auto &d : digests )
+    if ( d.of_ciphertext == of_ciphertext )
+      checked(EVP_DigestUpdate,( d.ctx.get(), p, n ));
+}
 
-struct see_stderr : std::exception
+void hash_tee::log()
 {
-  const char *what() const noexcept override
+  for ( auto &d : digests )
   {
-    return "see stderr for details";
+    std::array<byte,EVP_MAX_MD_SIZE> md;
+    unsigned size;
+    checked(EVP_DigestFinal_ex,( d.ctx.get(), std::data(md), &size ));
+    std::clog << (d.of_ciphertext ? "ciphertext " : "plaintext ") << d.name
+      <<": "<< to_hex( std::span{std::data(md), size} ) <<'\n';
   }
-};
+}
 
-[[maybe_unused]]
-constexpr auto ssize_max_u = std::size_t{
-  std::numeric_limits<std::streamsize>::max() };
-constexpr auto   int_max_u =    unsigned{
-  std::numeric_limits<            int>::max() };
-auto to_int( const std::size_t sz, const std::string_view desc )
+void gcm_cipher::hash( const std::vector<std::string> &specs )
 {
-  if ( sz <= int_max_u )
-    return static_cast<int>(sz);
-  std::cerr << "error: "<< desc <<" doesn't fit into an int\n";
-  throw see_stderr{};
+  tee = std::empty(specs) ? nullptr : std::make_unique<hash_tee>( specs );
 }
 
-template<typename Bool>
-static auto aesgcm( Bool decrypt,
+gcm_cipher::gcm_cipher( const bool decrypt,
   const std::vector<byte> &iv, const aes_key &key,
-  std::istream &in, std::ostream &out )
+  const engine_options::implementation impl )
+{
+  if ( const auto in_tree = gcm_kernel::choose(impl) )
+    kernel.reset( new gcm_kernel{*in_tree} );
+  else
+    ctx.reset( checked(EVP_CIPHER_CTX_new,()) );
+  reset( decrypt, iv, key );
+}
+
+void gcm_cipher::reset( const bool decrypt,
+  const std::vector<byte> &iv, const aes_key &key )
 {
-  using std::cerr; using std::clog;
   using std::data; using std::size;
-  using    ::data; using    ::size;
-  using std::integral_constant;
+  using    ::data;
 
-  const auto &verb        = not decrypt ?    "encrypt"      :   "decrypt";
-  const auto &EVP_Init_ex = not decrypt ? EVP_EncryptInit_ex:EVP_DecryptInit_ex;
-  const auto &EVP_Update  = not decrypt ? EVP_EncryptUpdate :EVP_DecryptUpdate;
+  this->decrypt = decrypt;
+  stats = { .timing = stats.timing };
 
-  #define checked( func, args ) [&]{ \
-    if ( const auto res = func args ) \
-      return res; \
-    cerr << "error: " #func " failed\n"; \
-    throw see_stderr{}; \
-  }();
+  const auto &EVP_Init_ex = not decrypt ? EVP_EncryptInit_ex:EVP_DecryptInit_ex;
 
   if ( std::empty(iv) )
   {
     std::cerr << "error: zero-length IV\n";
     throw see_stderr{};
   }
-
-  const auto ctx = checked( EVP_CIPHER_CTX_new,() );
-  const auto ctxfree = [&]{ EVP_CIPHER_CTX_free(ctx); };
-  struct autoctxfree : decltype(ctxfree) { ~autoctxfree(){ (*this)(); } }
-    do_autoctxfree{ctxfree};
+  if ( kernel )
+  {
+    kernel->set_key( key );
+    kernel->reset( iv );
+    return;
+  }
 
   const auto cipher = std::visit( overload
   {
@@ -76,155 +195,414 @@ static auto aesgcm( Bool decrypt,
     []( const std::array<byte,bits<192>> & ){ return EVP_aes_192_gcm(); },
     []( const std::array<byte,bits<128>> & ){ return EVP_aes_128_gcm(); },
   }, key );
-  checked(EVP_Init_ex,(ctx, cipher, nullptr, nullptr, nullptr));
-  checked(EVP_CIPHER_CTX_ctrl,(ctx, EVP_CTRL_GCM_SET_IVLEN,
+  checked(EVP_Init_ex,(ctx.get(), cipher, nullptr, nullptr, nullptr));
+  checked(EVP_CIPHER_CTX_ctrl,(ctx.get(), EVP_CTRL_GCM_SET_IVLEN,
     to_int(size(iv),"IV size"), nullptr));
-  checked(EVP_Init_ex,(ctx, nullptr, nullptr, data(key), data(iv)));
+  checked(EVP_Init_ex,(ctx.get(), nullptr, nullptr, data(key), data(iv)));
+}
 
-  in .exceptions( {} );
-  out.exceptions( {} );
+void gcm_cipher::reset( const bool decrypt, const std::vector<byte> &iv )
+{
+  using std::data; using std::size;
+
+  this->decrypt = decrypt;
+  stats = { .timing = stats.timing };
+
+  if ( std::empty(iv) )
+  {
+    std::cerr << "error: zero-length IV\n";
+    throw see_stderr{};
+  }
+  if ( kernel )
+  {
+    kernel->reset( iv );
+    return;
+  }
+  checked(EVP_CipherInit_ex,(ctx.get(), nullptr, nullptr, nullptr, nullptr,
+    not decrypt));
+  checked(EVP_CIPHER_CTX_ctrl,(ctx.get(), EVP_CTRL_GCM_SET_IVLEN,
+    to_int(size(iv),"IV size"), nullptr));
+  checked(EVP_CipherInit_ex,(ctx.get(), nullptr, nullptr, nullptr, data(iv),
+    -1));
+}
+
+void gcm_cipher::update( const byte *const in, byte *const out,
+  const std::size_t n )
+{
+  const auto &EVP_Update = not decrypt ? EVP_EncryptUpdate:EVP_DecryptUpdate;
+  int out_size;
+  assert( n <= int_max_u );
+  const auto timed = stats.time( stats.crypto );
+  ++stats.cipher_calls;
+  UNAESGCM_PROBE1( update_start, n );
+  // the input before it's overwritten, if in place, and the output after
+  if ( tee )
+    decrypt ? tee->ciphertext( in, n ) : tee->plaintext( in, n );
+  if ( kernel )
+    out_size = kernel->update( decrypt, in, out, n ) ? static_cast<int>(n) : 0;
+  else
+    checked(EVP_Update,( ctx.get(), out, &out_size, in, static_cast<int>(n) ));
+  if ( tee )
+    decrypt ? tee->plaintext( out, n ) : tee->ciphertext( out, n );
+  stats.bytes_processed += static_cast<std::size_t>(out_size);
+  UNAESGCM_PROBE2( update_done, n, stats.bytes_processed );
+  if ( static_cast<std::size_t>(out_size) != n )
+  {
+    std::cerr << "error: "<< (not decrypt ? "encrypt" : "decrypt")
+      <<" failed after "<< stats.bytes_processed <<" bytes\n";
+    throw see_stderr{};
+  }
+}
+
+gcm_tag gcm_cipher::finalize_enc()
+{
+  using std::data; using std::size;
+  assert( not decrypt );
+  const auto timed = stats.time( stats.crypto );
+  ++stats.cipher_calls;
+  UNAESGCM_PROBE1( finalize_enc, stats.bytes_processed );
+  const auto tag = [&]
+  {
+    if ( kernel )
+      return kernel->finish();
+
+    int zero;
+    checked(EVP_EncryptFinal_ex,( ctx.get(), nullptr, &zero ));
+
+    gcm_tag tag;
+    checked(EVP_CIPHER_CTX_ctrl,( ctx.get(), EVP_CTRL_AEAD_GET_TAG,
+      size(tag), data(tag) ));
+    return tag;
+  }();
+  if ( tee )
+    tee->ciphertext( data(tag), size(tag) );
+  return tag;
+}
 
-  constexpr auto tag_size    = integral_constant<unsigned,bits<tag_bits>>{};
-  constexpr auto buffer_size = integral_constant<unsigned,4*1024>{};
-  static_assert( buffer_size >= tag_size );
+bool gcm_cipher::finalize_dec( gcm_tag tag )
+{
+  using std::data; using std::size;
+  assert( decrypt );
+  const auto timed = stats.time( stats.crypto );
+  ++stats.cipher_calls;
+  if ( tee )
+    tee->ciphertext( data(tag), size(tag) );
+  const auto authentic = [&]
+  {
+    if ( kernel )
+      return gcm_parts::tags_equal( kernel->finish(), tag );
+
+    checked(EVP_CIPHER_CTX_ctrl,( ctx.get(), EVP_CTRL_GCM_SET_TAG,
+      size(tag), data(tag) ));
+
+    int zero;
+    return EVP_DecryptFinal_ex(ctx.get(), nullptr, &zero) == 1;
+  }();
+  UNAESGCM_PROBE2( finalize_dec, stats.bytes_processed, int{authentic} );
+  return authentic;
+}
+
+// n bytes, or fewer at eof only
+static std::size_t read_chunk( std::istream &in, byte *const buf,
+  const std::size_t n, std::uintmax_t &total_read )
+{
+  static_assert( ssize_max_u >= int_max_u );
+  UNAESGCM_PROBE1( read_start, n );
+  in.read( reinterpret_cast<char *>(buf), static_cast<std::streamsize>(n) );
+  const auto got = static_cast<std::size_t>(in.gcount());
+  total_read += got;
+  UNAESGCM_PROBE2( read_done, got, total_read );
+  if ( not in.eof() and got != n )
+  {
+    std::cerr << "error: read failed after "<< total_read <<" bytes\n";
+    throw io_error{};
+  }
+  return got;
+}
+
+static void write_chunk( std::ostream &out, const byte *const buf,
+  const std::size_t n )
+{
+  UNAESGCM_PROBE1( write_start, n );
+  out.write(
+    reinterpret_cast<const char *>(buf),
+    static_cast<std::streamsize>(n) );
+  if ( not out )
+  {
+    const auto total_written = out.rdbuf()->pubseekoff(
+      0, std::ios_base::cur, std::ios_base::out );
+    std::cerr << "error: write failed after "<< total_written <<" bytes\n";
+    throw io_error{};
+  }
+  UNAESGCM_PROBE1( write_done, n );
+}
+
+// The same as aesgcm_stream, on three threads: this one de-/encrypts, while
+// one reads into and another writes from a small set of recycled buffers,
+// handed from stage to stage through queues. The reader holds back the last
+// tag_size bytes read so far when decrypting, carrying them over to the front
+// of the next buffer, so that the final ones reach the cipher as the tag.
+static bool aesgcm_pipelined( gcm_cipher &cipher,
+  std::istream &in, std::ostream &out, const engine_options &opts )
+{
+  const auto decrypt = cipher.decrypting();
+  const auto buffer_size = checked_buffer_size(opts);
+  // each stage counts into fields of its own
+  auto &stats = cipher.statistics();
+  stats.backend = "pipelined";
+  stats.chunk_size = buffer_size;
 
-  std::uintmax_t total_read{}, total_processed{};
+  struct chunk
+  {
+    byte *buf;
+    std::size_t n;
+    bool last;
+  };
+  constexpr std::size_t depth = 4;
+  std::array<alignedbuf<byte>,depth> buffers;
+  spsc_queue<byte *,depth> empty;
+  spsc_queue<chunk,depth> filled, done;
+  for ( auto &b : buffers )
+  {
+    b = alignedbuf<byte>( tag_size + buffer_size );
+    static_cast<void>( empty.push(std::data(b)) );
+  }
+  // written before the last chunk is pushed, read after it's popped
+  gcm_tag tag;
+  // the input digested as it's read, and the output as it's written, so
+  // that the cipher's thread only de-/encrypts
+  auto tee = cipher.take_hashes();
 
-  const auto read = [&]( const auto N )
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  const auto stage = [&]( auto &&body )
   {
-    fixcapvec<byte,N> buf;
-    static_assert( max_size(buf) <= ssize_max_u );  // TODO?: read piecewisely
-    in.read( reinterpret_cast<char *>(data(buf)), capacity(buf) );
-    buf.resize( static_cast<std::size_t>(in.gcount()) );
-    total_read += size(buf);
-    if ( not in.eof() )
+    try
+    {
+      body();
+    }
+    catch ( ... )
     {
-      if ( size(buf) != capacity(buf) )
       {
-        cerr << "error: read failed after "<< total_read <<" bytes\n";
-        throw see_stderr{};
+        const std::lock_guard lock{error_mutex};
+        if ( not error )
+          error = std::current_exception();
       }
+      empty.close(); filled.close(); done.close();
     }
-    return buf;
   };
 
-  const auto update = [&]( const auto in )
+  bool authentic = true;
   {
-    fixcapvec<byte,capacity(in)> out;
-    int out_size;
-    static_assert( max_size(in) <= int_max_u );  // TODO?: update piecewisely
-    checked(EVP_Update,( ctx, data(out), &out_size,
-      data(in), static_cast<int>(size(in)) ));
-    out.resize( static_cast<std::size_t>(out_size) );
-    total_processed += size(out);
-    if ( size(out) != size(in) )
+    std::jthread reader{ [&]{ stage( [&]
     {
-      cerr <<
-        "error: "<< verb <<" failed after "<< total_processed <<" bytes\n";
-      throw see_stderr{};
-    }
-    return out;
-  };
+      std::uintmax_t total_read = 0;
+      std::array<byte,tag_size> carry;
+      std::size_t held = 0;
+      for ( bool last = false; not last; )
+      {
+        const auto buf = empty.pop();
+        if ( not buf )
+          return;
+        std::copy_n( std::data(carry), held, *buf );
+        const auto got = [&]
+        {
+          const auto timed = stats.time( stats.read_wait );
+          return read_chunk( in, *buf+held, buffer_size, total_read );
+        }();
+        stats.bytes_read += got;
+        if ( tee )
+          decrypt ? tee->ciphertext( *buf+held, got ) :
+                    tee->plaintext ( *buf+held, got );
+        last = got != buffer_size;
+        auto n = held + got;
+        if ( decrypt )
+        {
+          if ( n < tag_size )
+          {
+            std::cerr << "error: input too short ("<< total_read <<" bytes)\n";
+            throw see_stderr{};
+          }
+          n -= tag_size;
+          std::copy_n( *buf+n, tag_size, last ? std::data(tag) : std::data(carry) );
+          held = tag_size;
+        }
+        if ( not filled.push({*buf, n, last}) )
+          return;
+      }
+    } ); } };
 
-  const auto write = [&]( const auto buf )
-  {
-    static_assert( max_size(buf) <= ssize_max_u );  // TODO?: write piecewisely
-    out.write(
-      reinterpret_cast<const char *>(data(buf)),
-      static_cast<std::streamsize>(size(buf)) );
-    if ( not out )
+    std::jthread writer{ [&]{ stage( [&]
     {
-      const auto total_written = out.rdbuf()->pubseekoff(
-        0, std::ios_base::cur, std::ios_base::out );
-      cerr << "error: write failed after "<< total_written <<" bytes\n";
-      throw see_stderr{};
-    }
-  };
+      for ( bool last = false; not last; )
+      {
+        const auto c = done.pop();
+        if ( not c )
+          return;
+        if ( tee )
+          decrypt ? tee->plaintext ( c->buf, c->n ) :
+                    tee->ciphertext( c->buf, c->n );
+        const auto timed = stats.time( stats.write_wait );
+        write_chunk( out, c->buf, c->n );
+        stats.bytes_written += c->n;
+        if ( (last = c->last) and not decrypt )
+        {
+          if ( tee )
+            tee->ciphertext( std::data(tag), tag_size );
+          write_chunk( out, std::data(tag), tag_size );
+          stats.bytes_written += tag_size;
+        }
+        if ( not empty.push(c->buf) )
+          return;
+      }
+    } ); } };
 
-  const auto finalize_enc = [&]
-  {
-    int zero;
-    checked(EVP_EncryptFinal_ex,( ctx, nullptr, &zero ));
+    stage( [&]
+    {
+      for ( bool last = false; not last; )
+      {
+        const auto c = filled.pop();
+        if ( not c )
+          return;
+        cipher.update( c->buf, c->buf, c->n );
+        if ( (last = c->last) )
+        {
+          if ( not decrypt )
+            tag = cipher.finalize_enc();
+          if ( opts.verbose )
+            log_result( decrypt, cipher.total_processed(), tag );
+          if ( decrypt )
+            authentic = cipher.finalize_dec(tag);
+        }
+        if ( not done.push(*c) )
+          return;
+      }
+    } );
+  }
+  cipher.give_hashes( std::move(tee) );
+  if ( error )
+    std::rethrow_exception( error );
+  return authentic;
+}
 
-    clog << "ciphertext size: "<< total_processed <<" bytes\n";
+bool aesgcm_stream( gcm_cipher &cipher,
+  std::istream &in, std::ostream &out, const engine_options &opts )
+{
+  using std::cerr;
+  using std::data;
 
-    std::array<byte,tag_size> tag;
-    checked(EVP_CIPHER_CTX_ctrl,( ctx, EVP_CTRL_AEAD_GET_TAG,
-      size(tag), data(tag) ));
+  const auto decrypt = cipher.decrypting();
 
-    clog << "tag: "<< hexed(tag) <<'\n';
-    write(tag);
-    return true;
-  };
+  in .exceptions( {} );
+  out.exceptions( {} );
+
+  auto &stats = cipher.statistics();
+  stats.timing = opts.stats_fd >= 0;
+  if ( opts.pipelined )
+    return aesgcm_pipelined( cipher, in, out, opts );
+
+  const auto buffer_size = checked_buffer_size(opts);
+  stats.backend = "stream";
+  stats.chunk_size = buffer_size;
+
+  // Room for one chunk plus a (decrypt-only) lookbehind of one tag size in
+  // front of it. The data is decrypted in place; whatever trails the last
+  // processed byte is slid to the front, never more than tag_size bytes.
+  const alignedbuf<byte> ring( tag_size + buffer_size );
+  std::size_t held = 0;
 
-  const auto finalize_dec = [&]<typename Cont>( Cont &&ct_tail_and_tag )
+  std::uintmax_t total_read{};
+
+  const auto read = [&]( byte *const buf, const std::size_t n )
   {
-    assert( size(ct_tail_and_tag) >= tag_size );
-    const auto  ct =  pop_back(ct_tail_and_tag,  tag_size);
-    const auto tag = tail(std::forward<Cont>(ct_tail_and_tag), tag_size);
-    write(update(ct));
+    const auto timed = stats.time( stats.read_wait );
+    const auto got = read_chunk( in, buf, n, total_read );
+    stats.bytes_read += got;
+    return got;
+  };
 
-    clog
-      << "plaintext size: "<< total_processed <<" bytes\n"
-      << "tag: "<< hexed(tag) <<'\n'
-    ;
+  const auto update = [&]( byte *const buf, const std::size_t n )
+  {
+    cipher.update( buf, buf, n );
+  };
 
-    checked(EVP_CIPHER_CTX_ctrl,( ctx, EVP_CTRL_GCM_SET_TAG,
-      tag_size, const_cast<byte *>(data(tag)) ));
+  const auto write = [&]( const byte *const buf, const std::size_t n )
+  {
+    const auto timed = stats.time( stats.write_wait );
+    write_chunk( out, buf, n );
+    stats.bytes_written += n;
+  };
 
-    int zero;
-    return EVP_DecryptFinal_ex(ctx, nullptr, &zero) == 1;
+  const auto finalize_enc = [&]
+  {
+    const auto tag = cipher.finalize_enc();
+    if ( opts.verbose )
+      log_result( decrypt, cipher.total_processed(), tag );
+    write(data(tag), std::size(tag));
+    return true;
   };
 
-  #undef checked
+  const auto finalize_dec = [&]( byte *const ct_tail_and_tag,
+    const std::size_t ct_tail_size )
+  {
+    update(ct_tail_and_tag, ct_tail_size);
+    write (ct_tail_and_tag, ct_tail_size);
+    gcm_tag tag;
+    std::copy_n( ct_tail_and_tag+ct_tail_size, tag_size, data(tag) );
+    if ( opts.verbose )
+      log_result( decrypt, cipher.total_processed(), tag );
+    return cipher.finalize_dec(tag);
+  };
 
   if ( not decrypt ) for (;;)
   {
-    auto input = read(buffer_size);
-    const auto eof = size(input) != buffer_size;
-    write(update( std::move(input) ));
-    if ( eof )
+    const auto chunk = data(ring);
+    const auto got = read(chunk, buffer_size);
+    update(chunk, got);
+    write (chunk, got);
+    if ( got != buffer_size )
       return finalize_enc();
   }
-  else for ( fixcapvec<byte,tag_size> lookbehind; ; )
+  else for (;;)
   {
-    auto input = read(buffer_size);
-    if ( size(input) == buffer_size )
-    {
-      write(update(lookbehind));
-      lookbehind = {};
-      const auto lookahead = read(tag_size);
-      if ( size(lookahead) == tag_size )
-      {
-        write(update(input));
-        lookbehind = lookahead;
-        continue;
-      }
-      else  // eof
-        return finalize_dec( cat(input,lookahead) );
-    }
-    else  // eof
+    const auto got = read(data(ring)+held, buffer_size);
+    const auto avail = held + got;
+    if ( avail < tag_size )
     {
-      auto ext_input = cat(lookbehind,input);
-      if ( size(ext_input) >= tag_size )
-        return finalize_dec( std::move(ext_input) );
-      else
-      {
-        cerr << "error: input too short ("<< total_read <<" bytes)\n";
-        throw see_stderr{};
-      }
+      cerr << "error: input too short ("<< total_read <<" bytes)\n";
+      throw see_stderr{};
     }
+    const auto body = avail - tag_size;
+    if ( got != buffer_size )  // eof
+      return finalize_dec(data(ring), body);
+    update(data(ring), body);
+    write (data(ring), body);
+    std::copy_n( data(ring)+body, tag_size, data(ring) );
+    held = tag_size;
   }
 }
 
-enum verb : bool { encrypt, decrypt };
-
 void aesgcm(
   const std::vector<byte> &iv, const aes_key &key,
-  std::istream &in, std::ostream &out )
-{ aesgcm(std::integral_constant<verb,encrypt>{}, iv, key, in, out); }
+  std::istream &in, std::ostream &out, const engine_options &opts )
+{
+  gcm_cipher cipher{encrypt, iv, key, opts.cipher};
+  cipher.hash( opts.hashes );
+  [[maybe_unused]] const auto ok = aesgcm_stream( cipher, in, out, opts );
+  if ( opts.verbose )
+    cipher.log_hashes();
+  emit_stats( cipher.statistics(), opts, encrypt );
+}
 
 bool unaesgcm(
   const std::vector<byte> &iv, const aes_key &key,
-  std::istream &in, std::ostream &out )
-{ return aesgcm(std::integral_constant<verb,decrypt>{}, iv, key, in, out); }
+  std::istream &in, std::ostream &out, const engine_options &opts )
+{
+  gcm_cipher cipher{decrypt, iv, key, opts.cipher};
+  cipher.hash( opts.hashes );
+  const auto authentic = aesgcm_stream( cipher, in, out, opts );
+  if ( opts.verbose )
+    cipher.log_hashes();
+  emit_stats( cipher.statistics(), opts, decrypt, {}, authentic );
+  return authentic;
+}
@@ -9,6 +9,8 @@
 #include <utility>
 #include <limits>
 #include <iosfwd>
+#include <cstdint>
+#include <stop_token>
 
 template<std::size_t N>
 struct bits_to_bytes
@@ -65,13 +67,187 @@ constexpr auto size( const std::variant<T...> &v )
   return std::visit( [](const auto &cont){return size(cont);}, v );
 }
 
+struct engine_options
+{
+  // bytes read, processed and written at a time; must not exceed INT_MAX-16
+  std::size_t buffer_size = 256*1024;
+  // for seekable input and output only; 0 means one per CPU core
+  unsigned threads = 1;
+  // log sizes and tags to clog
+  bool verbose = true;
+  // when decrypting a regular file, optionally check the tag by a cheaper
+  // GHASH-only pass beforehand, and write nothing at all if it's wrong
+  // (first), or don't decrypt in any case (only)
+  enum class verification { during, first, only };
+  verification verify = verification::during;
+  // for streams and other unmappable input: read, de-/encrypt and write on
+  // three threads, so that waiting for I/O and the crypto overlap
+  bool pipelined = false;
+  // for named files: do all I/O through io_uring instead of mapping or
+  // streaming, where available, and only when checking the tag during and
+  // keeping the output in the page cache (see out_cache)
+  bool io_uring = false;
+  // whose AES-GCM does the work: the in-tree one, at the widest the CPU
+  // supports, with libcrypto's for everything else (automatic), or the one
+  // given
+  enum class implementation
+    { automatic, libcrypto, aesni, vaes_avx2, vaes_avx512 };
+  implementation cipher = implementation::automatic;
+  // after each operation, write a line of JSON to this descriptor, if any,
+  // with what the operation read, processed and wrote, and the wall-clock and
+  // CPU time it spent waiting for input, de-/encrypting and waiting for output
+  int stats_fd = -1;
+  // for named regular output files, which are preallocated in any case: keep
+  // what's written in the page cache, write it back and drop it behind the
+  // write cursor (along with the input read), or bypass the cache with
+  // O_DIRECT where the filesystem allows (or else drop it)
+  enum class output_cache { keep, drop, direct };
+  output_cache out_cache = output_cache::keep;
+  // when decrypting into a regular file and checking the tag during, keep
+  // the (untrustworthy) output of a wrong tag rather than truncating the file
+  // (or removing it, if it was created)
+  bool keep_unauthentic = false;
+  // digests to take of the data on its way through, and log after the tag:
+  // by OpenSSL name ("sha256", "blake2b512"...), of the plaintext, or, with
+  // a "ciphertext:" prefix, of the ciphertext and its tag; with pipelined,
+  // on the reader and writer threads, off the cipher's. Single named files
+  // are processed on one thread, and by the in-process cipher, to take them.
+  std::vector<std::string> hashes = {};
+};
+
+void aesgcm(
+  const std::vector<byte> &iv, const aes_key &key,
+  std::istream &in, std::ostream &out, const engine_options & = {} );
+
+[[nodiscard]]
+bool unaesgcm(
+  const std::vector<byte> &iv, const aes_key &key,
+  std::istream &in, std::ostream &out, const engine_options & = {} );
+
+// Same, but on named files. A regular input file is mapped into memory and
+// processed in a single pass (taking the tag, if any, from its end up front),
+// and a regular output file is sized in advance and mapped as well.
 void aesgcm(
   const std::vector<byte> &iv, const aes_key &key,
-  std::istream &in, std::ostream &out );
+  const char *in_path, const char *out_path, const engine_options & = {} );
 
 [[nodiscard]]
 bool unaesgcm(
   const std::vector<byte> &iv, const aes_key &key,
-  std::istream &in, std::ostream &out );
+  const char *in_path, const char *out_path, const engine_options & = {} );
+
+// Decrypts only bytes [offset, offset+length) of the plaintext, WITHOUT
+// authenticating them. A regular input file is read from the offset on
+// directly, and the length is clipped at its tag; any other input is read
+// through up to the offset and taken to contain no tag.
+void unaesgcm_range(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *in_path, const char *out_path,
+  std::uint64_t offset, std::uint64_t length = UINT64_MAX,
+  const engine_options & = {} );
+
+// Decrypts in_path into the regular file out_path like unaesgcm, but saves
+// its progress (how much has been decrypted, and the GHASH so far, MACed
+// under the key) to checkpoint_path every so many bytes. If checkpoint_path
+// holds a checkpoint of the same IV and key already, out_path is cut back to
+// what it says was decrypted, and in_path taken to be the REST of the
+// ciphertext, from there on. The checkpoint is removed once the input has
+// been authenticated (an input cut short isn't); like the key, it mustn't be
+// shared.
+[[nodiscard]]
+bool unaesgcm_resumable(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *in_path, const char *out_path, const char *checkpoint_path,
+  std::uint64_t checkpoint_every = std::uint64_t{64} << 20,
+  const engine_options & = {} );
+
+// Downloads url (HTTP(S), from a server that takes range requests, or
+// anything else libcurl does) over up to `connections` connections at once,
+// a byte range each, decrypting each range as it arrives, at its own position
+// in the counter sequence, into its place in the regular file out_path,
+// preallocated. The GHASHes of the ranges are combined for the tag in the
+// end. Returns whether the download was authentic; if not, out_path is
+// discarded as by aesgcm_files (unless opts.keep_unauthentic).
+[[nodiscard]]
+bool unaesgcm_fetch(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *url, const char *out_path, unsigned connections = 4,
+  const engine_options & = {} );
+
+// Encrypts the regular file in_path under a new IV (96 bits) and 256-bit key
+// from the CSPRNG straight into the body of an HTTP PUT to url (an upload
+// slot, as granted by XEP-0363), a chunk at a time as libcurl sends it, the
+// length given up front. Returns the aesgcm URL to share: url under the
+// aesgcm scheme, with the IV and key as its fragment.
+std::string aesgcm_upload( const char *in_path, const char *url,
+  const engine_options & = {} );
+
+// Encrypts in_path into out_path (each read and written in order, so either
+// may be a pipe) and, in the same pass, writes an index of the ciphertext to
+// index_path: the GHASH chain at every `every` bytes (a multiple of 16), and,
+// if mac, an HMAC of it under the key. Like the key, it mustn't be shared.
+void aesgcm_indexed(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *in_path, const char *out_path, const char *index_path,
+  std::uint64_t every = std::uint64_t{16} << 20, bool mac = true,
+  const engine_options & = {} );
+
+// Checks every segment of the regular file in_path between two points of the
+// index at index_path (the last one against the tag) on opts.threads threads,
+// and returns the numbers of those that don't lead on to the next; none means
+// that the input is authentic as a whole, with or without the index's MAC.
+// Without it, the numbers are a hint only (and a warning says so), as the
+// index itself could be what's wrong.
+[[nodiscard]]
+std::vector<std::uint64_t> unaesgcm_check_index(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *in_path, const char *index_path, const engine_options & = {} );
+
+// Like unaesgcm_range on a regular file, but authenticated: the segments the
+// window touches, and only those, are checked against the MACed index at
+// index_path first. Writes nothing and returns false unless they pass.
+[[nodiscard]]
+bool unaesgcm_range_indexed(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *in_path, const char *out_path, const char *index_path,
+  std::uint64_t offset, std::uint64_t length = UINT64_MAX,
+  const engine_options & = {} );
+
+// a new IV and key, and the file to encrypt under them
+struct transcrypt_target
+{
+  std::vector<byte> iv;
+  aes_key key;
+  std::string out_path;
+};
+
+// Decrypts in_path and, in the same pass, encrypts each chunk of plaintext
+// (while still in cache) under every target's IV and key. The outputs are
+// written to temporary files beside them, and renamed into place only once
+// the input has been authenticated; otherwise they're removed, and nothing
+// is written. The plaintext never touches the disk. Returns whether the
+// input was authentic.
+[[nodiscard]]
+bool unaesgcm_transcrypt(
+  const std::vector<byte> &iv, const aes_key &key, const char *in_path,
+  const std::vector<transcrypt_target> &, const engine_options & = {} );
+
+// Processes every "in_path<TAB>out_path<TAB>hex_IV|hex_256bit_key" line of
+// the manifest on opts.threads threads, one file per thread at a time, or
+// (small regular input files, unless io_uring) a group of
+// them at once, one per lane of the in-tree kernel's vector registers.
+// Reports "ok", "auth-fail", "io-error" or "error" and the input path, one
+// line per file, in order of completion. Returns whether all were ok.
+[[nodiscard]]
+bool aesgcm_batch( bool decrypt,
+  std::istream &manifest, std::ostream &report, const engine_options & = {} );
+
+// Serves requests as described in daemonproto.hpp on a Unix socket created
+// at socket_path (for its owner only), until a stop is requested. Requests
+// are read from an epoll loop and processed on opts.threads threads, and
+// initialized contexts are kept for reuse by later requests under the same
+// key.
+void aesgcm_daemon( const char *socket_path,
+  const engine_options & = {}, std::stop_token = {} );
 
 #endif
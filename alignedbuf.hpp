@@ -0,0 +1,35 @@
+
+#ifndef UNAESGCM_ALIGNEDBUF_HPP
+#define UNAESGCM_ALIGNEDBUF_HPP
+
+#include <memory>
+#include <new>
+#include <cstddef>
+
+// a fixed-size, heap-allocated, suitably (i. e. overly) aligned byte array
+template<typename T, std::size_t Alignment = 64>
+class alignedbuf
+{
+  struct deleter
+  {
+    void operator()( T *const p ) const noexcept
+    { ::operator delete[]( p, std::align_val_t{Alignment} ); }
+  };
+  std::unique_ptr<T[],deleter> _data;
+  std::size_t                  _size = 0;
+public:
+  alignedbuf() = default;
+  explicit alignedbuf( const std::size_t size )
+    : _data{ static_cast<T *>(
+        ::operator new[]( size*sizeof(T), std::align_val_t{Alignment} )) }
+    , _size{size}
+  {}
+  auto  data() const { return _data.get(); }
+  auto  size() const { return _size; }
+  bool empty() const { return !size(); }
+  auto begin() const { return data(); }
+  auto   end() const { return data()+size(); }
+  static constexpr auto alignment() { return Alignment; }
+};
+
+#endif
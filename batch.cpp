@@ -0,0 +1,249 @@
+#include "posixio.hpp"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+namespace
+{
+  struct job
+  {
+    std::string in, out, iv_and_key;
+  };
+
+  // "input<TAB>output<TAB>hex_IV|hex_256bit_key"; blank lines and #comments
+  // yield nothing
+  std::optional<job> parse_line( const std::string_view line )
+  {
+    if ( line.empty() or line.front() == '#' )
+      return {};
+    const auto tab1 = line.find('\t');
+    const auto tab2 = line.find('\t', tab1+1);
+    if ( tab1 == line.npos or tab2 == line.npos )
+      throw std::runtime_error{"expected 3 tab-separated fields"};
+    return job{
+      std::string{line.substr(0, tab1)},
+      std::string{line.substr(tab1+1, tab2-tab1-1)},
+      std::string{line.substr(tab2+1)} };
+  }
+
+  // Inputs up to this size are read whole and go through gcm_multi() in
+  // groups of up to group_files files or group_bytes bytes per worker.
+  constexpr auto small_file  = std::size_t{1} << 20;
+  constexpr auto group_files = std::size_t{64};
+  constexpr auto group_bytes = std::size_t{8} << 20;
+
+  struct small_job
+  {
+    std::size_t line;
+    job j;
+    std::vector<byte> iv;
+    aes_key key;
+    std::vector<byte> data;
+    engine_stats stats;
+  };
+
+  // the whole of a small regular file, or nothing if it isn't one
+  std::optional<std::vector<byte>> read_small( const char *const path,
+    const std::size_t min_size, engine_stats &stats )
+  {
+    const auto timed = stats.time( stats.read_wait );
+    const unique_fd in{ ::open(path, O_RDONLY|O_CLOEXEC) };
+    if ( not in )
+      sys_failed( "open", path );
+    struct stat st;
+    if ( ::fstat(in.get(), &st) )
+      sys_failed( "stat", path );
+    const auto in_size = static_cast<std::size_t>(st.st_size);
+    if ( not S_ISREG(st.st_mode) or in_size > small_file or
+         in_size < min_size )
+      return {};
+    std::vector<byte> data( in_size + tag_size );
+    if ( read_fully(in.get(), std::data(data), in_size) != in_size )
+    {
+      std::cerr << "error: '"<< path <<"' shrank while being read\n";
+      throw io_error{};
+    }
+    data.resize( in_size );
+    stats.bytes_read = in_size;
+    return data;
+  }
+}
+
+bool aesgcm_batch( const bool decrypt,
+  std::istream &manifest, std::ostream &report, const engine_options &opts )
+{
+  std::vector<std::string> lines;
+  for ( std::string line; std::getline(manifest, line); )
+    lines.push_back( std::move(line) );
+
+  // files are processed one per thread each, and quietly
+  auto file_opts = opts;
+  file_opts.threads = 1;
+  file_opts.verbose = false;
+  const auto threads = std::max( 1u, opts.threads ? opts.threads :
+    std::thread::hardware_concurrency() );
+
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> all_ok{true};
+  std::mutex report_mutex;
+
+  const auto report_status = [&]( const std::size_t i,
+    const std::optional<job> &j, const std::string_view status )
+  {
+    if ( status != "ok" )
+      all_ok = false;
+    const std::lock_guard lock{report_mutex};
+    report << status <<'\t'<< (j ? j->in : "line "+ std::to_string(i+1))
+      << std::endl;
+  };
+  const auto guarded = [&]( const std::size_t i, const auto &f )
+    -> std::string_view
+  {
+    try
+    {
+      return f();
+    }
+    catch ( const io_error & ) { return "io-error"; }
+    catch ( const std::exception &e )
+    {
+      if ( not dynamic_cast<const see_stderr *>(&e) )
+        std::cerr << "error: line "<< i+1 <<": "<< e.what() <<'\n';
+      return "error";
+    }
+  };
+
+  using verification = engine_options::verification;
+  const auto verify = decrypt ? opts.verify : verification::during;
+  // the io_uring path is per file
+  const auto grouping = not opts.io_uring;
+
+  const auto work = [&]
+  {
+    // one context per worker, reset for every file
+    std::optional<gcm_cipher> cipher;
+
+    std::vector<small_job> group;
+    std::size_t group_size = 0;
+    const auto flush = [&]
+    {
+      std::vector<gcm_message> messages;
+      for ( auto &g : group )
+      {
+        auto &m = messages.emplace_back( gcm_message{ g.iv, g.key,
+          std::data(g.data), std::data(g.data), std::size(g.data), {} } );
+        if ( decrypt )
+        {
+          m.size -= tag_size;
+          std::copy_n( std::data(g.data)+m.size, tag_size, std::data(m.tag) );
+        }
+      }
+      // the group's crypto time is shared out by size
+      engine_stats::stage crypto;
+      const auto status = guarded( group.front().line, [&]
+        {
+          const auto timed = group.front().stats.time( crypto );
+          gcm_multi( decrypt, messages, file_opts.cipher );
+          return "ok";
+        } );
+      for ( std::size_t k = 0; k < std::size(group); ++k )
+      {
+        auto &g = group[k];
+        auto &m = messages[k];
+        const auto share = [&]( const std::int64_t t )
+        {
+          return static_cast<std::int64_t>( double(t) *
+            double(std::size(g.data)) / double(std::max(group_size, 1ul)) );
+        };
+        g.stats.crypto = { share(crypto.wall_ns), share(crypto.cpu_ns) };
+        g.stats.cipher_calls = 1;
+        g.stats.bytes_processed = m.size;
+        report_status( g.line, g.j, status != "ok" ? status :
+          guarded( g.line, [&]() -> std::string_view
+          {
+            if ( verify == verification::only or
+                 (verify == verification::first and not m.authentic) )
+              return m.authentic ? "ok" : "auth-fail";
+            if ( decrypt and not m.authentic and not opts.keep_unauthentic )
+            {
+              // as with aesgcm_files: none of it written, and nothing left
+              // of what was there
+              struct stat st;
+              if ( ::stat(g.j.out.c_str(), &st) == 0 and
+                   S_ISREG(st.st_mode) and ::truncate(g.j.out.c_str(), 0) )
+                sys_failed( "truncate", g.j.out );
+              return "auth-fail";
+            }
+            if ( not decrypt )
+            {
+              g.data.insert( std::end(g.data), std::begin(m.tag),
+                std::end(m.tag) );
+              m.size += tag_size;
+            }
+            const auto timed = g.stats.time( g.stats.write_wait );
+            const unique_fd out{ ::open(g.j.out.c_str(),
+              O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0666) };
+            if ( not out )
+              sys_failed( "open", g.j.out );
+            write_fully( out.get(), std::data(g.data), m.size );
+            g.stats.bytes_written = m.size;
+            return m.authentic ? "ok" : "auth-fail";
+          } ) );
+        if ( status == "ok" )
+          emit_stats( g.stats, opts, decrypt, g.j.in,
+            decrypt ? std::optional{m.authentic} : std::nullopt );
+      }
+      group.clear();
+      group_size = 0;
+    };
+
+    for ( std::size_t i; (i = next++) < std::size(lines); )
+    {
+      std::optional<job> j;
+      const auto status = guarded( i, [&]() -> std::string_view
+        {
+          if ( not (j = parse_line(lines[i])) )
+            return {};
+          const auto [iv, key] = parse_iv_and_key( j->iv_and_key );
+          engine_stats stats{ .backend = "multi",
+            .timing = opts.stats_fd >= 0 };
+          if ( grouping and not std::empty(iv) )
+            if ( auto data = read_small( j->in.c_str(),
+                   decrypt ? tag_size : 0, stats ) )
+            {
+              stats.chunk_size = std::size(*data);
+              group_size += std::size(*data);
+              group.push_back( small_job{ i, std::move(*j), iv, key,
+                std::move(*data), stats } );
+              return {};
+            }
+          if ( cipher )
+            cipher->reset( decrypt, iv, key );
+          else
+            cipher.emplace( decrypt, iv, key, file_opts.cipher );
+          const auto authentic = aesgcm_files( *cipher, iv, key,
+            j->in.c_str(), j->out.c_str(), file_opts );
+          emit_stats( cipher->statistics(), opts, decrypt, j->in,
+            decrypt ? std::optional{authentic} : std::nullopt );
+          return authentic ? "ok" : "auth-fail";
+        } );
+      if ( not std::empty(status) )
+        report_status( i, j, status );
+      else if ( std::size(group) == group_files or group_size >= group_bytes )
+        flush();
+    }
+    if ( not std::empty(group) )
+      flush();
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    for ( auto t = 1u; t < threads; ++t )
+      workers.emplace_back( work );
+    work();
+  }
+  return all_ok;
+}
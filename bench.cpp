@@ -0,0 +1,281 @@
+#include "aesgcm.hpp"
+#include "engine.hpp"
+#include "gcmkernel.hpp"
+#include "posixio.hpp"
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <map>
+#include <cstdlib>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Prints a JSON array of throughput measurements to stdout. The sole optional
+// argument is the largest payload size, 256M by default; payloads grow by a
+// factor of 16 starting from 16 bytes.
+
+namespace
+{
+  using clk = std::chrono::steady_clock;
+
+  // the in-tree ciphers, over memory like the baseline
+  const std::map<std::string_view,cipher_impl> memory_backends
+  {
+    { "memory-aesni",       cipher_impl::aesni },
+    { "memory-vaes-avx2",   cipher_impl::vaes_avx2 },
+    { "memory-vaes-avx512", cipher_impl::vaes_avx512 },
+  };
+
+  std::optional<std::uint64_t> cycles()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return {};
+#endif
+  }
+
+  struct sample
+  {
+    double seconds;
+    std::optional<double> cycles;
+    std::size_t reps;
+  };
+
+  // repeats f until at least a quarter second has passed
+  sample measure( const std::function<void()> &f )
+  {
+    const auto c0 = cycles();
+    const auto t0 = clk::now();
+    std::size_t reps = 0;
+    do
+      f(), ++reps;
+    while ( clk::now() - t0 < std::chrono::milliseconds{250} );
+    const auto t1 = clk::now();
+    const auto c1 = cycles();
+    sample s{ std::chrono::duration<double>(t1-t0).count() / double(reps),
+      {}, reps };
+    if ( c0 and c1 )
+      s.cycles = double(*c1 - *c0) / double(reps);
+    return s;
+  }
+
+  aes_key make_key( const unsigned bits )
+  {
+    switch ( bits )
+    {
+      case 128: return std::array<byte,16>{1,2,3};
+      case 192: return std::array<byte,24>{1,2,3};
+      default:  return std::array<byte,32>{1,2,3};
+    }
+  }
+
+  std::string temp_path( const char *const name )
+  {
+    const auto dir = std::getenv("TMPDIR");
+    return std::string{dir ? dir : "/tmp"} + "/unaesgcm-bench-" +
+      std::to_string( ::getpid() ) + "-" + name;
+  }
+
+  // raw libcrypto (or the given cipher) over memory, in chunks of the same
+  // size as the engine's
+  void baseline( const bool decrypt, const std::vector<byte> &iv,
+    const aes_key &key, std::string &data, const std::size_t buffer_size,
+    const cipher_impl impl = cipher_impl::libcrypto )
+  {
+    gcm_cipher cipher{decrypt, iv, key, impl};
+    const auto p = reinterpret_cast<byte *>( std::data(data) );
+    const auto n = std::size(data) - (decrypt ? tag_size : 0);
+    for ( std::size_t off = 0; off < n; off += buffer_size )
+      cipher.update( p+off, p+off, std::min(buffer_size, n-off) );
+    if ( not decrypt )
+      static_cast<void>( cipher.finalize_enc() );
+    else
+      static_cast<void>( cipher.finalize_dec({}) );
+  }
+
+  // the data as separate messages of message_size bytes (tags excluded),
+  // all at once through gcm_multi()
+  void messages( const bool decrypt, const std::vector<byte> &iv,
+    const aes_key &key, std::string &data, const std::size_t message_size,
+    const cipher_impl impl )
+  {
+    const auto p = reinterpret_cast<byte *>( std::data(data) );
+    std::vector<gcm_message> ms;
+    for ( std::size_t off = 0; off < std::size(data); off += message_size )
+      ms.push_back( { iv, key, p+off, p+off,
+        std::min(message_size, std::size(data)-off), {} } );
+    gcm_multi( decrypt, ms, impl );
+  }
+
+  struct point
+  {
+    bool decrypt;
+    unsigned key_bits;
+    std::size_t iv_bytes, buffer_size, bytes;
+    std::string_view backend;
+  };
+
+  bool first = true;
+  void emit( const point &p, const sample &s, const sample &base )
+  {
+    const auto mbps = []( const std::size_t bytes, const sample &s )
+    { return double(bytes) / s.seconds / 1e6; };
+    std::cout << (first ? "[\n" : ",\n") << "  {"
+      << "\"op\": \""<< (p.decrypt ? "decrypt" : "encrypt") <<"\", "
+      << "\"key_bits\": "<< p.key_bits <<", "
+      << "\"iv_bytes\": "<< p.iv_bytes <<", "
+      << "\"buffer_size\": "<< p.buffer_size <<", "
+      << "\"backend\": \""<< p.backend <<"\", "
+      << "\"bytes\": "<< p.bytes <<", "
+      << "\"reps\": "<< s.reps <<", "
+      << "\"seconds\": "<< s.seconds <<", "
+      << "\"MBps\": "<< mbps(p.bytes, s) <<", "
+      << "\"cycles_per_byte\": ";
+    if ( s.cycles )
+      std::cout << *s.cycles / double(std::max<std::size_t>(p.bytes, 1));
+    else
+      std::cout << "null";
+    std::cout <<", "
+      << "\"baseline_MBps\": "<< mbps(p.bytes, base) <<", "
+      << "\"relative_to_baseline\": "<< base.seconds / s.seconds
+      << "}" << std::flush;
+    first = false;
+  }
+
+  void run( const point &p )
+  {
+    const auto key = make_key( p.key_bits );
+    std::vector<byte> iv( p.iv_bytes, 7 );
+    engine_options opts{ .buffer_size = p.buffer_size, .verbose = false,
+      .pipelined = p.backend.ends_with("-pipelined"),
+      .io_uring = p.backend.ends_with("-io_uring") };
+
+    std::string pt( p.bytes, 'x' ), input = pt;
+    if ( p.decrypt )
+    {
+      std::istringstream in{pt};
+      std::ostringstream out;
+      aesgcm( iv, key, in, out, opts );
+      input = out.str();
+    }
+
+    // many messages against as many libcrypto contexts set up one by one
+    if ( p.backend == "multi" )
+    {
+      std::string data( p.bytes, 'x' );
+      const auto s = measure( [&]
+      {
+        messages( p.decrypt, iv, key, data, p.buffer_size,
+          cipher_impl::automatic );
+      } );
+      const auto base = measure( [&]
+      {
+        messages( p.decrypt, iv, key, data, p.buffer_size,
+          cipher_impl::libcrypto );
+      } );
+      return emit( p, s, base );
+    }
+
+    std::function<void()> f;
+    const auto in_path = temp_path("in"), out_path = temp_path("out");
+    auto scratch = input;
+    if ( const auto impl = memory_backends.find(p.backend);
+         impl != end(memory_backends) )
+      f = [&]
+      {
+        baseline( p.decrypt, iv, key, scratch, p.buffer_size, impl->second );
+      };
+    else if ( p.backend == "istringstream" )
+      f = [&]
+      {
+        std::istringstream in{input};
+        std::ostringstream out;
+        gcm_cipher cipher{p.decrypt, iv, key};
+        static_cast<void>( aesgcm_stream(cipher, in, out, opts) );
+      };
+    else if ( p.backend.starts_with("pipe") )
+      f = [&]
+      {
+        int fds[2];
+        if ( ::pipe(fds) )
+          sys_failed( "pipe" );
+        const unique_fd r{fds[0]};
+        std::jthread writer{ [&, w = unique_fd{fds[1]}]
+        {
+          write_fully( w.get(),
+            reinterpret_cast<const byte *>(std::data(input)), std::size(input) );
+        } };
+        gcm_cipher cipher{p.decrypt, iv, key};
+        const auto path = "/dev/fd/"+ std::to_string(r.get());
+        static_cast<void>( aesgcm_files(cipher, iv, key,
+          path.c_str(), "/dev/null", opts) );
+      };
+    else
+    {
+      std::ofstream{in_path, std::ios_base::binary} << input;
+      f = [&]
+      {
+        gcm_cipher cipher{p.decrypt, iv, key};
+        static_cast<void>( aesgcm_files(cipher, iv, key, in_path.c_str(),
+          p.backend.starts_with("file") ? out_path.c_str() : "/dev/null",
+          opts) );
+      };
+    }
+
+    const auto s = measure( f );
+    scratch = input;
+    const auto base = measure( [&]
+    {
+      baseline( p.decrypt, iv, key, scratch, p.buffer_size );
+    } );
+    emit( p, s, base );
+    std::remove( in_path .c_str() );
+    std::remove( out_path.c_str() );
+  }
+}
+
+int main( const int argc, const char *const *const argv )
+try
+{
+  std::size_t max_size = 256 << 20;
+  if ( argc > 1 )
+    max_size = std::stoull( argv[1] );
+
+  constexpr auto default_buffer_size = engine_options{}.buffer_size;
+  for ( const auto decrypt : {false, true} )
+  {
+    for ( std::size_t bytes = 16; bytes <= max_size; bytes *= 16 )
+      for ( const auto key_bits : {128u, 192u, 256u} )
+        for ( const auto iv_bytes : {std::size_t{12}, std::size_t{64}} )
+          run( {decrypt, key_bits, iv_bytes, default_buffer_size, bytes,
+            "istringstream"} );
+    for ( const auto buffer_size : {4u<<10, 64u<<10, 256u<<10, 1u<<20, 8u<<20} )
+      run( {decrypt, 256, 12, buffer_size, std::min(max_size, 64ul<<20),
+        "istringstream"} );
+    for ( const auto &[backend, impl] : memory_backends )
+      if ( gcm_kernel::supported(impl) )
+        for ( std::size_t bytes = 16; bytes <= max_size; bytes *= 16 )
+          for ( const auto key_bits : {128u, 256u} )
+            run( {decrypt, key_bits, 12, default_buffer_size, bytes,
+              backend} );
+    for ( const auto message_size : {256u, 4u<<10, 64u<<10} )
+      for ( const auto key_bits : {128u, 256u} )
+        run( {decrypt, key_bits, 12, message_size,
+          std::min(max_size, 16ul<<20), "multi"} );
+    for ( const auto backend : {"pipe", "pipe-pipelined", "pipe-io_uring",
+           "file", "file-io_uring", "devnull"} )
+      for ( std::size_t bytes = 4096; bytes <= max_size; bytes *= 64 )
+        run( {decrypt, 256, 12, default_buffer_size, bytes, backend} );
+  }
+  std::cout << "\n]\n";
+}
+catch ( const std::exception &e )
+{
+  std::cerr << "bench: "<< e.what() <<'\n';
+  return 1;
+}
@@ -0,0 +1,63 @@
+#include "daemonproto.hpp"
+#include "basename.hpp"
+#include <fcntl.h>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+
+// A stand-in for [un]aesgcm-real that has a running daemon do the work: the
+// files are opened here, with the caller's permissions, and handed over.
+// The daemon's socket is taken from $UNAESGCM_SOCKET.
+
+int main( const int argc, const char *const *const argv )
+{
+  std::optional<bool> decrypt_maybe;
+  const auto bn = basename( std::string_view{argc ? argv[0] : ""} );
+  if ( bn ==   "aesgcm-client" ) decrypt_maybe = false;
+  if ( bn == "unaesgcm-client" ) decrypt_maybe = true;
+
+  const auto socket_path = std::getenv( "UNAESGCM_SOCKET" );
+  if ( not decrypt_maybe or not socket_path or argc < 2 or argc > 4 or
+       argc == 3 )
+  {
+    std::clog <<
+      "usage: UNAESGCM_SOCKET=socket_path [un]aesgcm-client"
+        " hex_IV|hex_256bit_key [in_file out_file]\n";
+    return 2;
+  }
+
+  const auto fail = []( const std::string_view what, const char *const path )
+  {
+    std::clog << "error: "<< what <<" '"<< path <<"' failed: "
+      << std::strerror(errno) <<'\n';
+    return 1;
+  };
+  const auto in  = argc > 2 ?
+    ::open( argv[2], O_RDONLY|O_CLOEXEC ) : STDIN_FILENO;
+  if ( in < 0 )
+    return fail( "open", argv[2] );
+  const auto out = argc > 3 ?
+    ::open( argv[3], O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0666 ) : STDOUT_FILENO;
+  if ( out < 0 )
+    return fail( "open", argv[3] );
+  const auto sock = daemonproto::connect( socket_path );
+  if ( sock < 0 )
+    return fail( "connect", socket_path );
+
+  const int fds[] = {in, out};
+  const auto line = std::string{*decrypt_maybe ? "decrypt" : "encrypt"} +
+    '\t'+ argv[1] +"\t\t\n";
+  if ( not daemonproto::send_request(sock, line, fds) )
+    return fail( "send", socket_path );
+  const auto status = daemonproto::receive_reply( sock );
+  if ( status == "ok" )
+    return 0;
+  if ( status == "auth-fail" )
+    std::clog <<
+      "authentication failed (input may have been tampered with, "
+      "output is untrustworthy)\n";
+  else
+    std::clog << "error: "<< (status ? *status : "no reply") <<" from '"
+      << socket_path <<"' (see the daemon's stderr)\n";
+  return 1;
+}
@@ -0,0 +1,56 @@
+#ifndef UNAESGCM_CURLIO_HPP
+#define UNAESGCM_CURLIO_HPP
+
+// libcurl handles, for the engines that do their own HTTP
+
+#include "engine.hpp"
+#include <curl/curl.h>
+
+struct curl_easy_delete
+{
+  void operator()( CURL *const c ) const { curl_easy_cleanup(c); }
+};
+using curl_easy = std::unique_ptr<CURL,curl_easy_delete>;
+
+struct curl_multi_delete
+{
+  void operator()( CURLM *const m ) const { curl_multi_cleanup(m); }
+};
+using curl_multi = std::unique_ptr<CURLM,curl_multi_delete>;
+
+struct curl_slist_delete
+{
+  void operator()( curl_slist *const l ) const { curl_slist_free_all(l); }
+};
+using curl_headers = std::unique_ptr<curl_slist,curl_slist_delete>;
+
+[[noreturn]] inline void curl_failed( const std::string_view what,
+  const char *const why )
+{
+  std::cerr << "error: "<< what <<" failed: "<< why <<'\n';
+  throw io_error{};
+}
+
+template<typename T>
+inline void set( CURL *const c, const CURLoption opt, const T value )
+{
+  if ( const auto res = curl_easy_setopt(c, opt, value); res != CURLE_OK )
+    curl_failed( "curl_easy_setopt", curl_easy_strerror(res) );
+}
+
+// a handle with what every transfer here has in common
+inline curl_easy new_easy( const char *const url, char *const error )
+{
+  static const auto global = curl_global_init( CURL_GLOBAL_DEFAULT );
+  if ( global != CURLE_OK )
+    curl_failed( "curl_global_init", curl_easy_strerror(global) );
+  curl_easy c{ checked(curl_easy_init,()) };
+  set( c.get(), CURLOPT_URL, url );
+  set( c.get(), CURLOPT_ERRORBUFFER, error );
+  set( c.get(), CURLOPT_FOLLOWLOCATION, 1L );
+  set( c.get(), CURLOPT_FAILONERROR, 1L );
+  set( c.get(), CURLOPT_NOSIGNAL, 1L );
+  return c;
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include "posixio.hpp"
+#include "daemonproto.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <csignal>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+  // Idle contexts, most recently used first. A request under a key seen
+  // lately takes one over and only sets the IV, skipping the key schedule.
+  class cipher_cache
+  {
+    static constexpr std::size_t capacity = 64;
+    std::mutex mutex;
+    std::list<std::pair<aes_key,gcm_cipher>> idle;
+
+  public:
+    gcm_cipher take( const bool decrypt,
+      const std::vector<byte> &iv, const aes_key &key,
+      const engine_options::implementation impl )
+    {
+      std::optional<gcm_cipher> cached;
+      {
+        const std::lock_guard lock{mutex};
+        const auto it = std::find_if( begin(idle), end(idle),
+          [&]( const auto &e ){ return e.first == key; } );
+        if ( it != end(idle) )
+        {
+          cached.emplace( std::move(it->second) );
+          idle.erase( it );
+        }
+      }
+      if ( not cached )
+        return gcm_cipher{decrypt, iv, key, impl};
+      cached->reset( decrypt, iv );
+      return std::move( *cached );
+    }
+
+    void give_back( const aes_key &key, gcm_cipher &&cipher )
+    {
+      const std::lock_guard lock{mutex};
+      idle.emplace_front( key, std::move(cipher) );
+      if ( size(idle) > capacity )
+        idle.pop_back();
+    }
+  };
+
+  // as received so far, and finally in full
+  struct request
+  {
+    unique_fd conn;
+    std::string line;
+    std::vector<unique_fd> fds;
+  };
+
+  std::string_view serve( request &r, cipher_cache &cache,
+    const engine_options &opts )
+  {
+    try
+    {
+      std::vector<std::string_view> fields;
+      for ( std::string_view rest = r.line; ; )
+      {
+        const auto tab = rest.find('\t');
+        fields.push_back( rest.substr(0, tab) );
+        if ( tab == rest.npos )
+          break;
+        rest.remove_prefix( tab+1 );
+      }
+      if ( size(fields) != 4 or
+           (fields[0] != "encrypt" and fields[0] != "decrypt") )
+        throw std::runtime_error{"malformed request"};
+
+      auto next_fd = begin(r.fds);
+      const auto path = [&]( const std::string_view p )
+      {
+        if ( not p.empty() )
+          return std::string{p};
+        if ( next_fd == end(r.fds) )
+          throw std::runtime_error{"missing file descriptor"};
+        return "/dev/fd/"+ std::to_string( (next_fd++)->get() );
+      };
+      const auto in = path( fields[2] ), out = path( fields[3] );
+
+      const auto decrypt = fields[0] == "decrypt";
+      const auto [iv, key] = parse_iv_and_key( fields[1] );
+      auto cipher = cache.take( decrypt, iv, key, opts.cipher );
+      const auto ok = aesgcm_files( cipher, iv, key,
+        in.c_str(), out.c_str(), opts );
+      emit_stats( cipher.statistics(), opts, decrypt, fields[2],
+        decrypt ? std::optional{ok} : std::nullopt );
+      cache.give_back( key, std::move(cipher) );
+      return ok ? "ok" : "auth-fail";
+    }
+    catch ( const io_error & ) { return "io-error"; }
+    catch ( const std::exception &e )
+    {
+      if ( not dynamic_cast<const see_stderr *>(&e) )
+        std::cerr << "error: "<< e.what() <<'\n';
+      return "error";
+    }
+  }
+
+  enum class progress { partial, complete, broken };
+
+  // drains what the client has sent so far
+  progress receive( request &r )
+  {
+    char buf[4096];
+    alignas(cmsghdr) char control[
+      CMSG_SPACE(daemonproto::max_fds*sizeof(int))];
+    for ( ;; )
+    {
+      iovec iov{ buf, sizeof buf };
+      msghdr msg{};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof control;
+      const auto n = ::recvmsg( r.conn.get(), &msg, MSG_CMSG_CLOEXEC );
+      if ( n < 0 and errno == EINTR )
+        continue;
+      if ( n < 0 )
+        return errno == EAGAIN or errno == EWOULDBLOCK ?
+          progress::partial : progress::broken;
+      for ( auto c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c) )
+        if ( c->cmsg_level == SOL_SOCKET and c->cmsg_type == SCM_RIGHTS )
+          for ( auto i = 0u; i < (c->cmsg_len - CMSG_LEN(0))/sizeof(int); ++i )
+          {
+            int fd;
+            std::memcpy( &fd, CMSG_DATA(c)+i*sizeof(int), sizeof fd );
+            r.fds.emplace_back( fd );
+          }
+      if ( n == 0 or msg.msg_flags & MSG_CTRUNC or
+           size(r.fds) > daemonproto::max_fds )
+        return progress::broken;
+      r.line.append( buf, static_cast<std::size_t>(n) );
+      if ( const auto nl = r.line.find('\n'); nl != r.line.npos )
+      {
+        r.line.resize( nl );
+        return progress::complete;
+      }
+      if ( size(r.line) > daemonproto::max_line )
+        return progress::broken;
+    }
+  }
+
+  // a work queue for the pool of threads that do the crypto
+  class queue
+  {
+    std::mutex mutex;
+    std::condition_variable_any cv;
+    std::deque<request> q;
+
+  public:
+    void push( request &&r )
+    {
+      {
+        const std::lock_guard lock{mutex};
+        q.push_back( std::move(r) );
+      }
+      cv.notify_one();
+    }
+
+    std::optional<request> pop( const std::stop_token stop )
+    {
+      std::unique_lock lock{mutex};
+      if ( not cv.wait(lock, stop, [&]{ return not q.empty(); }) )
+        return {};
+      auto r = std::move( q.front() );
+      q.pop_front();
+      return r;
+    }
+  };
+}
+
+void aesgcm_daemon( const char *const socket_path,
+  const engine_options &opts, const std::stop_token stop )
+{
+  // a client that goes away mid-request must not take the daemon with it
+  std::signal( SIGPIPE, SIG_IGN );
+
+  sockaddr_un addr;
+  if ( not daemonproto::fill_address(addr, socket_path) )
+  {
+    std::cerr << "error: socket path too long: '"<< socket_path <<"'\n";
+    throw see_stderr{};
+  }
+  const unique_fd listener{ ::socket( AF_UNIX,
+    SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0 ) };
+  if ( not listener )
+    sys_failed( "socket" );
+  // a leftover from an earlier run is replaced, anything else is not
+  if ( struct stat st; ::lstat(socket_path, &st) == 0 and S_ISSOCK(st.st_mode) )
+    ::unlink( socket_path );
+  // the socket is for the owner only: requests carry keys
+  const auto old_mask = ::umask( 077 );
+  const auto bound = ::bind( listener.get(),
+    reinterpret_cast<const sockaddr *>(&addr), sizeof addr );
+  ::umask( old_mask );
+  if ( bound or ::listen(listener.get(), SOMAXCONN) )
+    sys_failed( "bind", socket_path );
+
+  const unique_fd wake{ ::eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK) };
+  const unique_fd ep{ ::epoll_create1(EPOLL_CLOEXEC) };
+  if ( not wake or not ep )
+    sys_failed( "epoll" );
+  const auto watch = [&]( const int fd )
+  {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if ( ::epoll_ctl(ep.get(), EPOLL_CTL_ADD, fd, &ev) )
+      sys_failed( "epoll_ctl" );
+  };
+  watch( listener.get() );
+  watch( wake.get() );
+  const std::stop_callback on_stop{ stop, [&]
+  {
+    const std::uint64_t one = 1;
+    [[maybe_unused]] const auto w = ::write( wake.get(), &one, sizeof one );
+  } };
+
+  // files are processed one per thread each, and quietly, as in batches
+  auto file_opts = opts;
+  file_opts.threads = 1;
+  file_opts.verbose = false;
+  const auto threads = std::max( 1u, opts.threads ? opts.threads :
+    std::thread::hardware_concurrency() );
+
+  cipher_cache cache;
+  queue work;
+  std::vector<std::jthread> workers;
+  for ( auto t = 0u; t < threads; ++t )
+    workers.emplace_back( [&]( const std::stop_token stop )
+    {
+      while ( auto r = work.pop(stop) )
+      {
+        const auto status = std::string{serve(*r, cache, file_opts)} + '\n';
+        // the client may be gone already
+        [[maybe_unused]] const auto n = ::send( r->conn.get(),
+          std::data(status), std::size(status), MSG_NOSIGNAL );
+      }
+    } );
+
+  std::unordered_map<int,request> conns;
+  for ( auto running = true; running; )
+  {
+    epoll_event events[64];
+    const auto n = ::epoll_wait( ep.get(), events, std::size(events), -1 );
+    if ( n < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+      sys_failed( "epoll_wait" );
+    }
+    for ( const auto &ev : std::span{events, static_cast<std::size_t>(n)} )
+    {
+      const auto fd = ev.data.fd;
+      if ( fd == wake.get() )
+        running = false;
+      else if ( fd == listener.get() )
+        for ( int c; (c = ::accept4(listener.get(), nullptr, nullptr,
+                SOCK_NONBLOCK|SOCK_CLOEXEC)) >= 0; )
+        {
+          conns.emplace( c, request{unique_fd{c}, {}, {}} );
+          watch( c );
+        }
+      else if ( const auto it = conns.find(fd); it != end(conns) )
+        switch ( receive(it->second) )
+        {
+          case progress::partial:
+            break;
+          case progress::complete:
+            ::epoll_ctl( ep.get(), EPOLL_CTL_DEL, fd, nullptr );
+            work.push( std::move(it->second) );
+            conns.erase( it );
+            break;
+          case progress::broken:
+            conns.erase( it );
+            break;
+        }
+    }
+  }
+  ::unlink( socket_path );
+}
@@ -0,0 +1,110 @@
+#ifndef UNAESGCM_DAEMONPROTO_HPP
+#define UNAESGCM_DAEMONPROTO_HPP
+
+// The daemon's wire protocol, over a Unix stream socket, one request per
+// connection. The client sends a single line,
+//   "encrypt|decrypt<TAB>hex_IV|hex_256bit_key<TAB>in_path<TAB>out_path\n",
+// where an empty path stands for the next file descriptor passed along with
+// the line (SCM_RIGHTS), and gets back a single line with the status, one of
+// "ok", "auth-fail", "io-error" or "error", as in batch reports.
+//
+// Only the client side lives here, for it to do without libcrypto.
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace daemonproto
+{
+  constexpr std::size_t max_fds = 2, max_line = 16*1024;
+
+  inline bool fill_address( sockaddr_un &addr, const std::string_view path )
+  {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if ( std::size(path) >= sizeof addr.sun_path )
+      return false;
+    path.copy( addr.sun_path, std::size(path) );
+    return true;
+  }
+
+  // returns -1 with errno set on failure
+  inline int connect( const std::string_view path )
+  {
+    sockaddr_un addr;
+    if ( not fill_address(addr, path) )
+      return errno = ENAMETOOLONG, -1;
+    const auto fd = ::socket( AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0 );
+    if ( fd < 0 )
+      return -1;
+    if ( ::connect(fd, reinterpret_cast<const sockaddr *>(&addr),
+           sizeof addr) )
+    {
+      const auto err = errno;
+      ::close( fd );
+      return errno = err, -1;
+    }
+    return fd;
+  }
+
+  // the descriptors go with the first byte; false with errno set on failure
+  inline bool send_request( const int sock, const std::string_view line,
+    const std::span<const int> fds )
+  {
+    if ( std::size(fds) > max_fds or std::empty(line) )
+      return errno = EINVAL, false;
+    alignas(cmsghdr) char control[CMSG_SPACE(max_fds*sizeof(int))]{};
+    for ( std::size_t sent = 0; sent != std::size(line); )
+    {
+      iovec iov{ const_cast<char *>(std::data(line)+sent), std::size(line)-sent };
+      msghdr msg{};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      if ( not sent and not std::empty(fds) )
+      {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(std::size(fds)*sizeof(int));
+        const auto c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type  = SCM_RIGHTS;
+        c->cmsg_len   = CMSG_LEN(std::size(fds)*sizeof(int));
+        std::memcpy( CMSG_DATA(c), std::data(fds), std::size(fds)*sizeof(int) );
+      }
+      const auto n = ::sendmsg( sock, &msg, MSG_NOSIGNAL );
+      if ( n < 0 )
+      {
+        if ( errno == EINTR )
+          continue;
+        return false;
+      }
+      sent += static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+  // the status line, without its newline; nothing if the daemon hung up
+  inline std::optional<std::string> receive_reply( const int sock )
+  {
+    std::string reply;
+    for ( char c; reply.size() < max_line; )
+    {
+      const auto n = ::read( sock, &c, 1 );
+      if ( n < 0 and errno == EINTR )
+        continue;
+      if ( n <= 0 )
+        return {};
+      if ( c == '\n' )
+        return reply;
+      reply += c;
+    }
+    return {};
+  }
+}
+
+#endif
@@ -0,0 +1,223 @@
+
+#ifndef UNAESGCM_ENGINE_HPP
+#define UNAESGCM_ENGINE_HPP
+
+// internals shared by the de-/encryption front ends
+
+#include "aesgcm.hpp"
+#include <openssl/evp.h>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <chrono>
+
+struct see_stderr : std::exception
+{
+  const char *what() const noexcept override
+  {
+    return "see stderr for details";
+  }
+};
+
+// a failure to read or write the data, as opposed to a usage or crypto error
+struct io_error : see_stderr {};
+
+constexpr auto ssize_max_u = std::size_t{
+  std::numeric_limits<std::streamsize>::max() };
+constexpr auto   int_max_u =    unsigned{
+  std::numeric_limits<            int>::max() };
+inline auto to_int( const std::size_t sz, const std::string_view desc )
+{
+  if ( sz <= int_max_u )
+    return static_cast<int>(sz);
+  std::cerr << "error: "<< desc <<" doesn't fit into an int\n";
+  throw see_stderr{};
+}
+
+#define checked( func, args ) [&]{ \
+  if ( const auto res = func args ) \
+    return res; \
+  std::cerr << "error: " #func " failed\n"; \
+  throw see_stderr{}; \
+}()
+
+enum verb : bool { encrypt, decrypt };
+
+constexpr auto tag_size = bits<tag_bits>;
+using gcm_tag = std::array<byte,tag_size>;
+
+struct evp_cipher_ctx_free
+{
+  void operator()( EVP_CIPHER_CTX *const c ) const { EVP_CIPHER_CTX_free(c); }
+};
+using evp_cipher_ctx = std::unique_ptr<EVP_CIPHER_CTX,evp_cipher_ctx_free>;
+
+std::size_t checked_buffer_size( const engine_options & );
+
+// logs the ciphertext/plaintext size and the tag to clog
+void log_result( bool decrypt, std::uintmax_t size, const gcm_tag & );
+
+// What an operation did, and where its time went, as counted by the engine
+// doing it; see engine_options::stats_fd.
+struct engine_stats
+{
+  // wall-clock time, and CPU time of the thread that was there, in ns
+  struct stage
+  {
+    std::int64_t wall_ns = 0, cpu_ns = 0;
+  };
+
+  std::string_view backend = "stream";
+  std::size_t chunk_size = 0;
+  std::uintmax_t bytes_read = 0, bytes_processed = 0, bytes_written = 0;
+  // into the cipher, be it EVP or the in-tree one
+  std::uintmax_t cipher_calls = 0;
+  stage read_wait{}, crypto{}, write_wait{};
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  // whether the stages are timed at all (at a system call or two per timing)
+  bool timing = false;
+
+  // adds the time from its construction to its destruction to a stage
+  class timer
+  {
+    stage *s;
+    std::chrono::steady_clock::time_point wall0;
+    std::int64_t cpu0 = 0;
+  public:
+    explicit timer( stage * );
+    timer( const timer & ) = delete;
+    ~timer();
+  };
+  [[nodiscard]] timer time( stage &s ) { return timer{timing ? &s : nullptr}; }
+};
+
+// writes the statistics of an operation to opts.stats_fd, if set
+void emit_stats( const engine_stats &, const engine_options &opts,
+  bool decrypt, std::string_view in_path = {},
+  std::optional<bool> authentic = {} );
+
+struct evp_md_ctx_free
+{
+  void operator()( EVP_MD_CTX *const c ) const { EVP_MD_CTX_free(c); }
+};
+using evp_md_ctx = std::unique_ptr<EVP_MD_CTX,evp_md_ctx_free>;
+
+// Digests of the plaintext and of the ciphertext (with its tag, as stored)
+// taken as the data goes by, while still in cache; see engine_options::hashes.
+// Those of the plaintext and those of the ciphertext may be fed from two
+// different threads.
+class hash_tee
+{
+  struct digest
+  {
+    std::string name;
+    bool of_ciphertext;
+    evp_md_ctx ctx;
+  };
+  std::vector<digest> digests;
+
+  void update( bool of_ciphertext, const byte *, std::size_t );
+
+public:
+  explicit hash_tee( const std::vector<std::string> &specs );
+
+  void plaintext ( const byte *p, std::size_t n ) { update( false, p, n ); }
+  void ciphertext( const byte *p, std::size_t n ) { update( true,  p, n ); }
+  // finishes the digests, and logs them to clog
+  void log();
+};
+
+class gcm_kernel;
+struct gcm_kernel_delete
+{
+  void operator()( gcm_kernel * ) const;
+};
+using gcm_kernel_ptr = std::unique_ptr<gcm_kernel,gcm_kernel_delete>;
+
+// an initialized AES-GCM context, fed one in-memory piece at a time: the
+// in-tree kernel's or else EVP's
+class gcm_cipher
+{
+  evp_cipher_ctx ctx;
+  gcm_kernel_ptr kernel;
+  bool decrypt;
+  engine_stats stats;
+  std::unique_ptr<hash_tee> tee;
+
+public:
+  gcm_cipher( bool decrypt, const std::vector<byte> &iv, const aes_key &,
+    engine_options::implementation = engine_options::implementation::automatic
+  );
+
+  // reinitializes the context for another message, without reallocating it
+  void reset( bool decrypt, const std::vector<byte> &iv, const aes_key & );
+  // same, under the key it was last set to, skipping the key schedule
+  void reset( bool decrypt, const std::vector<byte> &iv );
+
+  // in and out may be equal, but may not otherwise overlap; n <= INT_MAX
+  void update( const byte *in, byte *out, std::size_t n );
+
+  gcm_tag finalize_enc();
+  [[nodiscard]] bool finalize_dec( gcm_tag );
+
+  // takes the digests asked for, if any, of all that goes through update,
+  // and of the tag
+  void hash( const std::vector<std::string> &specs );
+  // for an engine that feeds them itself, elsewhere, and hands them back
+  std::unique_ptr<hash_tee> take_hashes() { return std::move(tee); }
+  void give_hashes( std::unique_ptr<hash_tee> t ) { tee = std::move(t); }
+  // finishes and logs the digests, if any
+  void log_hashes() { if ( tee ) tee->log(); }
+
+  auto decrypting()      const { return decrypt; }
+  auto total_processed() const { return stats.bytes_processed; }
+  // of the message, since the last reset; the engines add to it, too
+  auto &statistics()       { return stats; }
+  auto &statistics() const { return stats; }
+};
+
+// the engines proper, on a freshly (re)set cipher
+[[nodiscard]] bool aesgcm_stream( gcm_cipher &,
+  std::istream &in, std::ostream &out, const engine_options & );
+[[nodiscard]] bool aesgcm_files( gcm_cipher &,
+  const std::vector<byte> &iv, const aes_key &,
+  const char *in_path, const char *out_path, const engine_options & );
+
+// The same, from an open file to the one at out_path through io_uring, with
+// several reads and writes in flight. Nothing if io_uring is unavailable, in
+// which case nothing has been read yet, and the output not even opened.
+std::optional<bool> aesgcm_uring( gcm_cipher &,
+  int in, const char *in_path, const char *out_path, const engine_options & );
+
+// De-/encrypts n bytes from in to out (which mustn't overlap) split into
+// segments processed on opts.threads threads. Returns the tag of the
+// ciphertext, which is in when decrypting and out when encrypting. When
+// decrypting, out may be null to only compute the tag.
+gcm_tag gcm_parallel( bool decrypt,
+  const std::vector<byte> &iv, const aes_key &,
+  const byte *in, byte *out, std::size_t n, const engine_options &opts );
+
+// a whole message in memory, for gcm_multi()
+struct gcm_message
+{
+  std::vector<byte> iv;
+  aes_key key;
+  // in and out may be equal, but may not otherwise overlap
+  const byte *in;
+  byte *out;
+  std::size_t size;
+  // set when encrypting; expected when decrypting
+  gcm_tag tag;
+  bool authentic = true;
+};
+
+// De-/encrypts many independent messages, those under keys of the same size
+// side by side, one per lane of the in-tree kernel's vector registers (or
+// else one after the other), for throughput on small messages.
+void gcm_multi( bool decrypt, std::span<gcm_message>,
+  engine_options::implementation = engine_options::implementation::automatic
+);
+
+#endif
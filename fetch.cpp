@@ -0,0 +1,238 @@
+#include "posixio.hpp"
+#include "curlio.hpp"
+#include "gcmparts.hpp"
+#include "alignedbuf.hpp"
+#include <deque>
+#include <exception>
+#include <sys/stat.h>
+
+// One byte range of the input, [start, end), on a connection of its own: the
+// ciphertext in it is gathered into whole blocks, GHASHed and decrypted at
+// its own position in the counter sequence, and written at its own offset.
+// The last range has the tag, too.
+struct segment
+{
+  std::uint64_t start, end, body_end;
+  std::uint64_t received = 0;
+  const engine_options &opts;
+  engine_stats &stats;
+  const int out;
+  ghash_partial ghash;
+  gcm_ctr ctr;
+  alignedbuf<byte> buf;
+  std::size_t fill = 0;
+  std::uint64_t next;
+  gcm_tag &tag;
+  curl_easy easy;
+  char error[CURL_ERROR_SIZE] = {};
+  std::exception_ptr failure;
+
+  segment( const gcm_parts &parts, const char *const url,
+    const std::uint64_t start, const std::uint64_t end,
+    const std::uint64_t body_size, const std::size_t chunk, const int out,
+    gcm_tag &tag, const engine_options &opts, engine_stats &stats )
+    : start{start}, end{end}, body_end{std::min(end, body_size)}
+    , opts{opts}, stats{stats}, out{out}, ghash{parts}, ctr{parts}
+    , buf( chunk ), next{start}, tag{tag}, easy{new_easy(url, error)}
+  {
+    const auto range = std::to_string(start) +"-"+ std::to_string(end-1);
+    set( easy.get(), CURLOPT_RANGE, range.c_str() );
+    set( easy.get(), CURLOPT_WRITEFUNCTION, &segment::on_data );
+    set( easy.get(), CURLOPT_WRITEDATA, this );
+  }
+
+  void flush()
+  {
+    {
+      const auto timed = stats.time( stats.crypto );
+      ghash.update( std::data(buf), fill );
+      ctr.crypt( next/block_size, std::data(buf), std::data(buf), fill );
+      stats.cipher_calls += 2;
+      stats.bytes_processed += fill;
+    }
+    const auto timed = stats.time( stats.write_wait );
+    write_fully_at( out, std::data(buf), fill, static_cast<off_t>(next) );
+    stats.bytes_written += fill;
+    next += fill;
+    fill = 0;
+  }
+
+  void receive( const byte *p, std::size_t n )
+  {
+    // a server that ignores the range sends everything from the start
+    if ( not received )
+    {
+      long code = 0;
+      curl_easy_getinfo( easy.get(), CURLINFO_RESPONSE_CODE, &code );
+      if ( code != 206 and start != 0 )
+      {
+        std::cerr << "error: the server ignored a range request\n";
+        throw io_error{};
+      }
+    }
+    stats.bytes_read += n;
+    while ( n )
+    {
+      const auto at = start + received;
+      if ( at >= end )
+      {
+        std::cerr << "error: more data than asked for\n";
+        throw io_error{};
+      }
+      if ( at >= body_end )
+      {
+        const auto k = static_cast<std::size_t>(
+          std::min<std::uint64_t>(n, end-at) );
+        std::copy_n( p, k, std::data(tag) + (at-body_end) );
+        received += k; p += k; n -= k;
+        continue;
+      }
+      const auto k = static_cast<std::size_t>( std::min<std::uint64_t>(
+        {n, std::size(buf)-fill, body_end-at} ));
+      std::copy_n( p, k, std::data(buf)+fill );
+      fill += k; received += k; p += k; n -= k;
+      if ( fill == std::size(buf) or start+received == body_end )
+        flush();
+    }
+  }
+
+  static std::size_t on_data( char *const p, std::size_t, const std::size_t n,
+    void *const self )
+  {
+    auto &s = *static_cast<segment *>(self);
+    try
+    {
+      s.receive( reinterpret_cast<const byte *>(p), n );
+      return n;
+    }
+    catch ( ... )
+    {
+      s.failure = std::current_exception();
+      return 0;
+    }
+  }
+};
+
+bool unaesgcm_fetch(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const url, const char *const out_path,
+  const unsigned connections, const engine_options &opts )
+{
+  using std::data;
+
+  const gcm_parts parts{iv, key};
+  const auto chunk = std::max( checked_buffer_size(opts) / block_size,
+    std::size_t{1} ) * block_size;
+  engine_stats stats{ .backend = "fetch", .chunk_size = chunk,
+    .timing = opts.stats_fd >= 0 };
+
+  // the size, and where any redirects lead, up front
+  char error[CURL_ERROR_SIZE] = {};
+  const auto head = new_easy( url, error );
+  set( head.get(), CURLOPT_NOBODY, 1L );
+  if ( curl_easy_perform(head.get()) != CURLE_OK )
+    curl_failed( "fetching the size of "+ std::string{url}, error );
+  curl_off_t length = -1;
+  const char *effective = nullptr;
+  curl_easy_getinfo( head.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length );
+  curl_easy_getinfo( head.get(), CURLINFO_EFFECTIVE_URL, &effective );
+  if ( length < 0 )
+  {
+    std::cerr << "error: the server didn't tell the size of "<< url <<'\n';
+    throw io_error{};
+  }
+  const auto size = static_cast<std::uint64_t>(length);
+  if ( size < tag_size )
+  {
+    std::cerr << "error: input too short ("<< size <<" bytes)\n";
+    throw see_stderr{};
+  }
+  const auto body_size = size - tag_size;
+
+  const auto existed = ::access(out_path, F_OK) == 0;
+  const unique_fd out{ ::open(out_path, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,
+    0666) };
+  if ( not out )
+    sys_failed( "open", out_path );
+  struct stat st;
+  if ( ::fstat(out.get(), &st) or not S_ISREG(st.st_mode) )
+  {
+    std::cerr << "error: '"<< out_path <<"' is not a regular file\n";
+    throw see_stderr{};
+  }
+  preallocate( out.get(), body_size, out_path );
+  if ( ::ftruncate(out.get(), static_cast<off_t>(body_size)) )
+    sys_failed( "ftruncate", out_path );
+
+  // whole blocks each, bar the last, and not too small to bother
+  constexpr auto min_segment_size = std::uint64_t{64} << 10;
+  const auto segment_size = std::max( min_segment_size,
+    blocks_in(body_size / std::max(connections, 1u) + 1) * block_size );
+  const auto segments = std::max( std::uint64_t{1},
+    (body_size + segment_size-1) / segment_size );
+
+  gcm_tag tag;
+  std::deque<segment> ranges;
+  const curl_multi multi{ checked(curl_multi_init,()) };
+  // as many TCP connections as ranges, even over HTTP/2
+  curl_multi_setopt( multi.get(), CURLMOPT_PIPELINING, CURLPIPE_NOTHING );
+  for ( std::uint64_t k = 0; k != segments; ++k )
+  {
+    const auto end = k+1 == segments ? size : (k+1)*segment_size;
+    ranges.emplace_back( parts, effective, k*segment_size, end, body_size,
+      chunk, out.get(), tag, opts, stats );
+    if ( const auto res = curl_multi_add_handle( multi.get(),
+           ranges.back().easy.get() ); res != CURLM_OK )
+      curl_failed( "curl_multi_add_handle", curl_multi_strerror(res) );
+  }
+
+  for ( int running = 1; running; )
+  {
+    if ( const auto res = curl_multi_perform( multi.get(), &running );
+         res != CURLM_OK )
+      curl_failed( "curl_multi_perform", curl_multi_strerror(res) );
+    int queued;
+    while ( const auto m = curl_multi_info_read( multi.get(), &queued ) )
+    {
+      if ( m->msg != CURLMSG_DONE or m->data.result == CURLE_OK )
+        continue;
+      for ( const auto &s : ranges )
+        if ( s.easy.get() == m->easy_handle )
+        {
+          if ( s.failure )
+            std::rethrow_exception( s.failure );
+          curl_failed( "fetching "+ std::string{url},
+            *s.error ? s.error : curl_easy_strerror(m->data.result) );
+        }
+    }
+    if ( running )
+    {
+      const auto timed = stats.time( stats.read_wait );
+      if ( const auto res = curl_multi_poll( multi.get(),
+             nullptr, 0, 1000, nullptr ); res != CURLM_OK )
+        curl_failed( "curl_multi_poll", curl_multi_strerror(res) );
+    }
+  }
+
+  // the partials chained in order, as in gcm_parallel
+  gf128 acc;
+  for ( auto &s : ranges )
+  {
+    if ( s.received != s.end - s.start )
+    {
+      std::cerr << "error: fetching "<< url <<" was cut short\n";
+      throw io_error{};
+    }
+    acc = acc * parts.H.pow( blocks_in(s.body_end - s.start) ) ^
+      s.ghash.finish();
+  }
+  if ( opts.verbose )
+    log_result( decrypt, body_size, tag );
+  const auto authentic = gcm_parts::tags_equal(
+    parts.tag(acc, body_size), tag );
+  if ( not authentic and not opts.keep_unauthentic and
+       (existed ? ::truncate(out_path, 0) : ::unlink(out_path)) )
+    sys_failed( existed ? "truncate" : "unlink", out_path );
+  emit_stats( stats, opts, decrypt, url, authentic );
+  return authentic;
+}
@@ -0,0 +1,235 @@
+// The bulk loops of gcm_kernel, once per vector width: included by
+// gcmkernel.cpp into a namespace (and target region) of its own, after it has
+// defined there
+//
+//   vec, lanes                         the register type and its blocks
+//   load, store, broadcast, lane0      moves, lane0 zero-extending a block
+//   gather, scatter                    moves of one block per lane
+//   vxor, vor, enc, enclast, bswap     per-lane ops
+//   add32, shl32<n>, shr32<n>          per-lane ops on 32-bit elements
+//   shl_bytes<n>, shr_bytes<n>         per-lane shifts of the whole lane
+//   clmul<imm>, fold                   per-lane products, XOR of the lanes
+//   lane_offsets                       0, 1, .. in the lanes' counters
+//
+// and the one-block helpers of the SSE region.
+
+// reduce() of the SSE region, in every lane
+inline vec reduce_lanes( vec lo, const vec mid, vec hi )
+{
+  lo = vxor( lo, shl_bytes<8>(mid) );
+  hi = vxor( hi, shr_bytes<8>(mid) );
+
+  auto t7 = shr32<31>( lo ), t8 = shr32<31>( hi );
+  const auto t9 = shr_bytes<12>( t7 );
+  t8 = shl_bytes<4>( t8 );
+  t7 = shl_bytes<4>( t7 );
+  lo = vor( shl32<1>(lo), t7 );
+  hi = vor( vor(shl32<1>(hi), t8), t9 );
+
+  t7 = vxor( vxor(shl32<31>(lo), shl32<30>(lo)), shl32<25>(lo) );
+  t8 = shr_bytes<4>( t7 );
+  lo = vxor( lo, shl_bytes<12>(t7) );
+  const auto t2 = vxor( vxor(shr32<1>(lo), shr32<2>(lo)),
+    vxor(shr32<7>(lo), t8) );
+  return vxor( hi, vxor(lo, t2) );
+}
+
+void bulk( const gcm_kernel::schedule &s, const block &counter, block &acc,
+  const byte *in, byte *out, std::size_t blocks, const bool decrypt )
+{
+  constexpr auto per_batch = 8*lanes;
+  static_assert( per_batch <= std::tuple_size_v<decltype(s.h_powers)> );
+
+  const auto rounds = s.rounds;
+  vec k[15];
+  for ( auto r = 0u; r <= rounds; ++r )
+    k[r] = broadcast( load1(s.round_keys[r]) );
+  // H^per_batch..H^1, one power per block of a batch
+  vec h[8];
+  for ( auto j = 0u; j < 8; ++j )
+    h[j] = load( std::data(s.h_powers[size(s.h_powers) - per_batch + j*lanes]) );
+
+  // counters are kept byte-reversed, so that the 32 bits of inc32 are a lane
+  auto ctr = add32( broadcast(bswap1(load1(counter))), lane_offsets() );
+  const auto step = broadcast( _mm_setr_epi32(lanes, 0, 0, 0) );
+  auto a = bswap1( load1(acc) );
+
+  // The ciphertext of a batch is hashed while the next one is encrypted: its
+  // products with the powers of H are summed unreduced, and reduced once.
+  vec pending[8];
+  auto have_pending = false;
+  const auto hash_pending = [&]( vec &lo, vec &mid, vec &hi, const unsigned j )
+  {
+    lo  = vxor( lo, clmul<0x00>(pending[j], h[j]) );
+    hi  = vxor( hi, clmul<0x11>(pending[j], h[j]) );
+    mid = vxor( mid, vxor( clmul<0x01>(pending[j], h[j]),
+                           clmul<0x10>(pending[j], h[j]) ) );
+  };
+
+  for ( ; blocks >= per_batch; blocks -= per_batch,
+          in += per_batch*block_size, out += per_batch*block_size )
+  {
+    vec x[8];
+    for ( auto j = 0u; j < 8; ++j )
+    {
+      x[j] = vxor( bswap(ctr), k[0] );
+      ctr = add32( ctr, step );
+    }
+    vec lo = zero(), mid = zero(), hi = zero();
+    if ( have_pending )
+      pending[0] = vxor( pending[0], lane0(a) );
+    for ( auto r = 1u; r <= 8; ++r )
+    {
+      for ( auto j = 0u; j < 8; ++j )
+        x[j] = enc( x[j], k[r] );
+      if ( have_pending )
+        hash_pending( lo, mid, hi, r-1 );
+    }
+    for ( auto r = 9u; r < rounds; ++r )
+      for ( auto j = 0u; j < 8; ++j )
+        x[j] = enc( x[j], k[r] );
+    for ( auto j = 0u; j < 8; ++j )
+    {
+      const auto d = load( in  + j*lanes*block_size );
+      const auto o = vxor( enclast(x[j], k[rounds]), d );
+      store( out + j*lanes*block_size, o );
+      pending[j] = bswap( decrypt ? d : o );
+    }
+    if ( have_pending )
+      a = reduce( fold(lo), fold(mid), fold(hi) );
+    have_pending = true;
+  }
+  if ( have_pending )
+  {
+    vec lo = zero(), mid = zero(), hi = zero();
+    pending[0] = vxor( pending[0], lane0(a) );
+    for ( auto j = 0u; j < 8; ++j )
+      hash_pending( lo, mid, hi, j );
+    a = reduce( fold(lo), fold(mid), fold(hi) );
+  }
+
+  // the rest, less than a batch, one block at a time
+  auto c = low128( ctr );
+  const auto H = load1( s.h_powers.back() );
+  for ( ; blocks; --blocks, in += block_size, out += block_size )
+  {
+    const auto d = load1( in );
+    const auto o = _mm_xor_si128( encrypt1(s, bswap1(c)), d );
+    store1( out, o );
+    a = gfmul( _mm_xor_si128(a, bswap1(decrypt ? d : o)), H );
+    c = _mm_add_epi32( c, _mm_setr_epi32(1, 0, 0, 0) );
+  }
+  store1( std::data(acc), bswap1(a) );
+}
+
+// The multi-buffer loop: a separate message in every lane, under its own key
+// (of the same size for all), each advanced by the same number of blocks.
+// The counters and accumulators are updated in place.
+void multi( const gcm_kernel::schedule *const s[],
+  block *const counter[], block *const acc[],
+  const byte *const in[], byte *const out[], const std::size_t blocks,
+  const bool decrypt )
+{
+  const auto rounds = s[0]->rounds;
+  const auto gather_each = [&]( const auto f )
+  {
+    const byte *p[lanes];
+    for ( auto l = 0u; l < lanes; ++l )
+      p[l] = std::data( f(l) );
+    return gather( p, 0 );
+  };
+  vec k[15];
+  for ( auto r = 0u; r <= rounds; ++r )
+    k[r] = gather_each( [&]( const unsigned l ) -> auto &
+      { return s[l]->round_keys[r]; } );
+  // H^8..H^1, of every lane's own H
+  vec h[8];
+  for ( auto j = 0u; j < 8; ++j )
+    h[j] = gather_each( [&]( const unsigned l ) -> auto &
+      { return s[l]->h_powers[size(s[l]->h_powers) - 8 + j]; } );
+
+  auto ctr = bswap( gather_each( [&]( const unsigned l ) -> auto &
+    { return *counter[l]; } ) );
+  const auto one = broadcast( _mm_setr_epi32(1, 0, 0, 0) );
+  auto a = bswap( gather_each( [&]( const unsigned l ) -> auto &
+    { return *acc[l]; } ) );
+
+  vec pending[8];
+  auto have_pending = false;
+  const auto hash_pending = [&]( vec &lo, vec &mid, vec &hi, const unsigned j )
+  {
+    lo  = vxor( lo, clmul<0x00>(pending[j], h[j]) );
+    hi  = vxor( hi, clmul<0x11>(pending[j], h[j]) );
+    mid = vxor( mid, vxor( clmul<0x01>(pending[j], h[j]),
+                           clmul<0x10>(pending[j], h[j]) ) );
+  };
+  const auto encrypt = [&]( vec x )
+  {
+    x = vxor( x, k[0] );
+    for ( auto r = 1u; r < rounds; ++r )
+      x = enc( x, k[r] );
+    return enclast( x, k[rounds] );
+  };
+
+  std::size_t off = 0;
+  for ( auto left = blocks; left >= 8; left -= 8, off += 8*block_size )
+  {
+    vec x[8];
+    for ( auto j = 0u; j < 8; ++j )
+    {
+      x[j] = vxor( bswap(ctr), k[0] );
+      ctr = add32( ctr, one );
+    }
+    vec lo = zero(), mid = zero(), hi = zero();
+    if ( have_pending )
+      pending[0] = vxor( pending[0], a );
+    for ( auto r = 1u; r <= 8; ++r )
+    {
+      for ( auto j = 0u; j < 8; ++j )
+        x[j] = enc( x[j], k[r] );
+      if ( have_pending )
+        hash_pending( lo, mid, hi, r-1 );
+    }
+    for ( auto r = 9u; r < rounds; ++r )
+      for ( auto j = 0u; j < 8; ++j )
+        x[j] = enc( x[j], k[r] );
+    for ( auto j = 0u; j < 8; ++j )
+    {
+      const auto d = gather( in, off + j*block_size );
+      const auto o = vxor( enclast(x[j], k[rounds]), d );
+      scatter( out, off + j*block_size, o );
+      pending[j] = bswap( decrypt ? d : o );
+    }
+    if ( have_pending )
+      a = reduce_lanes( lo, mid, hi );
+    have_pending = true;
+  }
+  if ( have_pending )
+  {
+    vec lo = zero(), mid = zero(), hi = zero();
+    pending[0] = vxor( pending[0], a );
+    for ( auto j = 0u; j < 8; ++j )
+      hash_pending( lo, mid, hi, j );
+    a = reduce_lanes( lo, mid, hi );
+  }
+
+  for ( ; off < blocks*block_size; off += block_size )
+  {
+    const auto d = gather( in, off );
+    const auto o = vxor( encrypt(bswap(ctr)), d );
+    scatter( out, off, o );
+    ctr = add32( ctr, one );
+    pending[7] = vxor( a, bswap(decrypt ? d : o) );
+    vec lo = zero(), mid = zero(), hi = zero();
+    hash_pending( lo, mid, hi, 7 );
+    a = reduce_lanes( lo, mid, hi );
+  }
+
+  byte *p[lanes];
+  for ( auto l = 0u; l < lanes; ++l )
+    p[l] = std::data( *counter[l] );
+  scatter( p, 0, bswap(ctr) );
+  for ( auto l = 0u; l < lanes; ++l )
+    p[l] = std::data( *acc[l] );
+  scatter( p, 0, bswap(a) );
+}
@@ -0,0 +1,546 @@
+#include "gcmkernel.hpp"
+#include <cassert>
+#include <cstring>
+
+// Only GCC's target pragmas are relied upon to compile the vector code for
+// CPUs that the rest of the binary needn't require; elsewhere there is no
+// in-tree kernel, and libcrypto does all the work.
+#if defined(__x86_64__) && defined(__GNUC__) && not defined(__clang__)
+#define UNAESGCM_X86_KERNEL 1
+#include <immintrin.h>
+
+#pragma GCC push_options
+#pragma GCC target("aes,pclmul,ssse3,sse4.1")
+namespace x86
+{
+  // the one-block operations, also used by the wider code
+
+  [[gnu::always_inline]] inline __m128i load1( const byte *const p )
+  { return _mm_loadu_si128( reinterpret_cast<const __m128i *>(p) ); }
+  [[gnu::always_inline]] inline __m128i load1( const block &b )
+  { return load1( std::data(b) ); }
+  [[gnu::always_inline]] inline void store1( byte *const p, const __m128i x )
+  { _mm_storeu_si128( reinterpret_cast<__m128i *>(p), x ); }
+
+  [[gnu::always_inline]] inline __m128i bswap_mask()
+  { return _mm_setr_epi8( 15,14,13,12, 11,10,9,8, 7,6,5,4, 3,2,1,0 ); }
+  // GHASH operates on byte-reversed blocks, and so do the counters
+  [[gnu::always_inline]] inline __m128i bswap1( const __m128i x )
+  { return _mm_shuffle_epi8( x, bswap_mask() ); }
+
+  [[gnu::always_inline]] inline __m128i encrypt1(
+    const gcm_kernel::schedule &s, __m128i x )
+  {
+    x = _mm_xor_si128( x, load1(s.round_keys[0]) );
+    for ( auto r = 1u; r < s.rounds; ++r )
+      x = _mm_aesenc_si128( x, load1(s.round_keys[r]) );
+    return _mm_aesenclast_si128( x, load1(s.round_keys[s.rounds]) );
+  }
+
+  // The sum of the partial products (lo, mid, hi) of byte-reversed operands,
+  // reduced: Gueron and Kounavis, "Intel Carry-Less Multiplication
+  // Instruction and its Usage for Computing the GCM Mode", algorithms 2, 4.
+  [[gnu::always_inline]] inline __m128i reduce(
+    __m128i lo, const __m128i mid, __m128i hi )
+  {
+    lo = _mm_xor_si128( lo, _mm_slli_si128(mid, 8) );
+    hi = _mm_xor_si128( hi, _mm_srli_si128(mid, 8) );
+
+    // the product of bit-reflected operands is one bit short
+    auto t7 = _mm_srli_epi32( lo, 31 ), t8 = _mm_srli_epi32( hi, 31 );
+    const auto t9 = _mm_srli_si128( t7, 12 );
+    t8 = _mm_slli_si128( t8, 4 );
+    t7 = _mm_slli_si128( t7, 4 );
+    lo = _mm_or_si128( _mm_slli_epi32(lo, 1), t7 );
+    hi = _mm_or_si128( _mm_or_si128(_mm_slli_epi32(hi, 1), t8), t9 );
+
+    // modulo x^128 + x^7 + x^2 + x + 1
+    t7 = _mm_xor_si128( _mm_xor_si128(_mm_slli_epi32(lo, 31),
+      _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25) );
+    t8 = _mm_srli_si128( t7, 4 );
+    lo = _mm_xor_si128( lo, _mm_slli_si128(t7, 12) );
+    const auto t2 = _mm_xor_si128( _mm_xor_si128(_mm_srli_epi32(lo, 1),
+      _mm_srli_epi32(lo, 2)), _mm_xor_si128(_mm_srli_epi32(lo, 7), t8) );
+    return _mm_xor_si128( hi, _mm_xor_si128(lo, t2) );
+  }
+
+  [[gnu::always_inline]] inline __m128i gfmul( const __m128i a, const __m128i b )
+  {
+    return reduce( _mm_clmulepi64_si128(a, b, 0x00),
+      _mm_xor_si128( _mm_clmulepi64_si128(a, b, 0x01),
+                     _mm_clmulepi64_si128(a, b, 0x10) ),
+      _mm_clmulepi64_si128(a, b, 0x11) );
+  }
+
+  void encrypt_block( const gcm_kernel::schedule &s, block &b )
+  {
+    store1( std::data(b), encrypt1(s, load1(b)) );
+  }
+
+  void ghash( const gcm_kernel::schedule &s, block &acc, const block &b )
+  {
+    const auto x = _mm_xor_si128( bswap1(load1(acc)), bswap1(load1(b)) );
+    store1( std::data(acc), bswap1(gfmul(x, load1(s.h_powers.back()))) );
+  }
+
+  // FIPS 197, 5.2, with SubWord from AESENCLAST (whose ShiftRows has no
+  // effect on four equal columns): no tables, no key-dependent timing
+  void expand_key( gcm_kernel::schedule &s,
+    const byte *const key, const std::size_t key_size )
+  {
+    const auto sub_word = []( const std::uint32_t w )
+    {
+      const auto x = _mm_aesenclast_si128(
+        _mm_set1_epi32(static_cast<int>(w)), _mm_setzero_si128() );
+      return static_cast<std::uint32_t>( _mm_cvtsi128_si32(x) );
+    };
+    const auto nk = key_size / 4;
+    s.rounds = static_cast<unsigned>( nk + 6 );
+    std::uint32_t w[4*15];
+    std::memcpy( w, key, key_size );
+    std::uint32_t rcon = 1;
+    // j is i % nk, kept without dividing
+    for ( std::size_t i = nk, j = 0; i < 4*(s.rounds+1); ++i )
+    {
+      auto t = w[i-1];
+      if ( j == 0 )
+      {
+        t = sub_word( t >> 8 | t << 24 ) ^ rcon;
+        rcon = rcon << 1 ^ (rcon & 0x80 ? 0x11b : 0);
+      }
+      else if ( nk > 6 and j == 4 )
+        t = sub_word( t );
+      w[i] = w[i-nk] ^ t;
+      if ( ++j == nk )
+        j = 0;
+    }
+    std::memcpy( std::data(s.round_keys), w, 4*4*(s.rounds+1) );
+
+    block H{};
+    encrypt_block( s, H );
+    store1( std::data(s.h_powers.back()), bswap1(load1(H)) );
+    s.powers = 1;
+  }
+
+  // the powers of H up to H^n, from those there are
+  void extend_powers( gcm_kernel::schedule &s, const unsigned n )
+  {
+    const auto h = load1( s.h_powers.back() );
+    auto p = load1( s.h_powers[size(s.h_powers) - s.powers] );
+    for ( ; s.powers < n; ++s.powers )
+    {
+      p = gfmul( p, h );
+      store1( std::data(s.h_powers[size(s.h_powers) - s.powers - 1]), p );
+    }
+  }
+
+  namespace sse
+  {
+    using vec = __m128i;
+    constexpr unsigned lanes = 1;
+
+    [[gnu::always_inline]] inline vec load( const byte *const p )
+    { return load1( p ); }
+    [[gnu::always_inline]] inline void store( byte *const p, const vec x )
+    { store1( p, x ); }
+    [[gnu::always_inline]] inline vec broadcast( const __m128i x ) { return x; }
+    [[gnu::always_inline]] inline vec lane0( const __m128i x ) { return x; }
+    [[gnu::always_inline]] inline __m128i low128( const vec x ) { return x; }
+    [[gnu::always_inline]] inline __m128i fold( const vec x ) { return x; }
+    [[gnu::always_inline]] inline vec zero() { return _mm_setzero_si128(); }
+    [[gnu::always_inline]] inline vec vxor( const vec a, const vec b )
+    { return _mm_xor_si128( a, b ); }
+    [[gnu::always_inline]] inline vec enc( const vec x, const vec k )
+    { return _mm_aesenc_si128( x, k ); }
+    [[gnu::always_inline]] inline vec enclast( const vec x, const vec k )
+    { return _mm_aesenclast_si128( x, k ); }
+    [[gnu::always_inline]] inline vec bswap( const vec x ) { return bswap1( x ); }
+    [[gnu::always_inline]] inline vec add32( const vec a, const vec b )
+    { return _mm_add_epi32( a, b ); }
+    template<int Imm>
+    [[gnu::always_inline]] inline vec clmul( const vec a, const vec b )
+    { return _mm_clmulepi64_si128( a, b, Imm ); }
+    [[gnu::always_inline]] inline vec lane_offsets()
+    { return _mm_setzero_si128(); }
+    [[gnu::always_inline]] inline vec gather( const byte *const p[],
+      const std::size_t off )
+    { return load1( p[0]+off ); }
+    [[gnu::always_inline]] inline void scatter( byte *const p[],
+      const std::size_t off, const vec x )
+    { store1( p[0]+off, x ); }
+    [[gnu::always_inline]] inline vec vor( const vec a, const vec b )
+    { return _mm_or_si128( a, b ); }
+    template<int N>
+    [[gnu::always_inline]] inline vec shl32( const vec x )
+    { return _mm_slli_epi32( x, N ); }
+    template<int N>
+    [[gnu::always_inline]] inline vec shr32( const vec x )
+    { return _mm_srli_epi32( x, N ); }
+    template<int N>
+    [[gnu::always_inline]] inline vec shl_bytes( const vec x )
+    { return _mm_slli_si128( x, N ); }
+    template<int N>
+    [[gnu::always_inline]] inline vec shr_bytes( const vec x )
+    { return _mm_srli_si128( x, N ); }
+
+#include "gcmbulk.ipp"
+  }
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("aes,pclmul,ssse3,sse4.1,avx2,vaes,vpclmulqdq")
+namespace x86::avx2
+{
+  using vec = __m256i;
+  constexpr unsigned lanes = 2;
+
+  [[gnu::always_inline]] inline vec load( const byte *const p )
+  { return _mm256_loadu_si256( reinterpret_cast<const vec *>(p) ); }
+  [[gnu::always_inline]] inline void store( byte *const p, const vec x )
+  { _mm256_storeu_si256( reinterpret_cast<vec *>(p), x ); }
+  [[gnu::always_inline]] inline vec broadcast( const __m128i x )
+  { return _mm256_broadcastsi128_si256( x ); }
+  [[gnu::always_inline]] inline vec lane0( const __m128i x )
+  { return _mm256_zextsi128_si256( x ); }
+  [[gnu::always_inline]] inline __m128i low128( const vec x )
+  { return _mm256_castsi256_si128( x ); }
+  [[gnu::always_inline]] inline __m128i fold( const vec x )
+  { return _mm_xor_si128( low128(x), _mm256_extracti128_si256(x, 1) ); }
+  [[gnu::always_inline]] inline vec zero() { return _mm256_setzero_si256(); }
+  [[gnu::always_inline]] inline vec vxor( const vec a, const vec b )
+  { return _mm256_xor_si256( a, b ); }
+  [[gnu::always_inline]] inline vec enc( const vec x, const vec k )
+  { return _mm256_aesenc_epi128( x, k ); }
+  [[gnu::always_inline]] inline vec enclast( const vec x, const vec k )
+  { return _mm256_aesenclast_epi128( x, k ); }
+  [[gnu::always_inline]] inline vec bswap( const vec x )
+  { return _mm256_shuffle_epi8( x, broadcast(bswap_mask()) ); }
+  [[gnu::always_inline]] inline vec add32( const vec a, const vec b )
+  { return _mm256_add_epi32( a, b ); }
+  template<int Imm>
+  [[gnu::always_inline]] inline vec clmul( const vec a, const vec b )
+  { return _mm256_clmulepi64_epi128( a, b, Imm ); }
+  [[gnu::always_inline]] inline vec lane_offsets()
+  { return _mm256_setr_epi32( 0,0,0,0, 1,0,0,0 ); }
+  [[gnu::always_inline]] inline vec gather( const byte *const p[],
+    const std::size_t off )
+  {
+    return _mm256_inserti128_si256( _mm256_castsi128_si256(load1(p[0]+off)),
+      load1(p[1]+off), 1 );
+  }
+  [[gnu::always_inline]] inline void scatter( byte *const p[],
+    const std::size_t off, const vec x )
+  {
+    store1( p[0]+off, low128(x) );
+    store1( p[1]+off, _mm256_extracti128_si256(x, 1) );
+  }
+  [[gnu::always_inline]] inline vec vor( const vec a, const vec b )
+  { return _mm256_or_si256( a, b ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shl32( const vec x )
+  { return _mm256_slli_epi32( x, N ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shr32( const vec x )
+  { return _mm256_srli_epi32( x, N ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shl_bytes( const vec x )
+  { return _mm256_bslli_epi128( x, N ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shr_bytes( const vec x )
+  { return _mm256_bsrli_epi128( x, N ); }
+
+#include "gcmbulk.ipp"
+}
+#pragma GCC pop_options
+
+// GCC 12 takes the deliberately undefined vectors of the AVX-512 intrinsics'
+// masked forms for uninitialized variables
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC push_options
+#pragma GCC target( \
+  "aes,pclmul,ssse3,sse4.1,avx2,vaes,vpclmulqdq,avx512f,avx512bw")
+namespace x86::avx512
+{
+  using vec = __m512i;
+  constexpr unsigned lanes = 4;
+
+  [[gnu::always_inline]] inline vec load( const byte *const p )
+  { return _mm512_loadu_si512( p ); }
+  [[gnu::always_inline]] inline void store( byte *const p, const vec x )
+  { _mm512_storeu_si512( p, x ); }
+  [[gnu::always_inline]] inline vec broadcast( const __m128i x )
+  { return _mm512_broadcast_i32x4( x ); }
+  [[gnu::always_inline]] inline vec lane0( const __m128i x )
+  { return _mm512_zextsi128_si512( x ); }
+  [[gnu::always_inline]] inline __m128i low128( const vec x )
+  { return _mm512_castsi512_si128( x ); }
+  [[gnu::always_inline]] inline __m128i fold( const vec x )
+  {
+    const auto y = _mm256_xor_si256( _mm512_castsi512_si256(x),
+      _mm512_extracti64x4_epi64(x, 1) );
+    return _mm_xor_si128( _mm256_castsi256_si128(y),
+      _mm256_extracti128_si256(y, 1) );
+  }
+  [[gnu::always_inline]] inline vec zero() { return _mm512_setzero_si512(); }
+  [[gnu::always_inline]] inline vec vxor( const vec a, const vec b )
+  { return _mm512_xor_si512( a, b ); }
+  [[gnu::always_inline]] inline vec enc( const vec x, const vec k )
+  { return _mm512_aesenc_epi128( x, k ); }
+  [[gnu::always_inline]] inline vec enclast( const vec x, const vec k )
+  { return _mm512_aesenclast_epi128( x, k ); }
+  [[gnu::always_inline]] inline vec bswap( const vec x )
+  { return _mm512_shuffle_epi8( x, broadcast(bswap_mask()) ); }
+  [[gnu::always_inline]] inline vec add32( const vec a, const vec b )
+  { return _mm512_add_epi32( a, b ); }
+  template<int Imm>
+  [[gnu::always_inline]] inline vec clmul( const vec a, const vec b )
+  { return _mm512_clmulepi64_epi128( a, b, Imm ); }
+  [[gnu::always_inline]] inline vec lane_offsets()
+  { return _mm512_setr_epi32( 0,0,0,0, 1,0,0,0, 2,0,0,0, 3,0,0,0 ); }
+  [[gnu::always_inline]] inline vec gather( const byte *const p[],
+    const std::size_t off )
+  {
+    auto x = _mm512_castsi128_si512( load1(p[0]+off) );
+    x = _mm512_inserti32x4( x, load1(p[1]+off), 1 );
+    x = _mm512_inserti32x4( x, load1(p[2]+off), 2 );
+    return _mm512_inserti32x4( x, load1(p[3]+off), 3 );
+  }
+  [[gnu::always_inline]] inline void scatter( byte *const p[],
+    const std::size_t off, const vec x )
+  {
+    store1( p[0]+off, low128(x) );
+    store1( p[1]+off, _mm512_extracti32x4_epi32(x, 1) );
+    store1( p[2]+off, _mm512_extracti32x4_epi32(x, 2) );
+    store1( p[3]+off, _mm512_extracti32x4_epi32(x, 3) );
+  }
+  [[gnu::always_inline]] inline vec vor( const vec a, const vec b )
+  { return _mm512_or_si512( a, b ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shl32( const vec x )
+  { return _mm512_slli_epi32( x, N ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shr32( const vec x )
+  { return _mm512_srli_epi32( x, N ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shl_bytes( const vec x )
+  { return _mm512_bslli_epi128( x, N ); }
+  template<int N>
+  [[gnu::always_inline]] inline vec shr_bytes( const vec x )
+  { return _mm512_bsrli_epi128( x, N ); }
+
+#include "gcmbulk.ipp"
+}
+#pragma GCC pop_options
+#pragma GCC diagnostic pop
+#endif
+
+void gcm_kernel_delete::operator()( gcm_kernel *const k ) const
+{
+  delete k;
+}
+
+bool gcm_kernel::supported( const cipher_impl impl )
+{
+#ifdef UNAESGCM_X86_KERNEL
+  __builtin_cpu_init();
+  const auto sse = __builtin_cpu_supports("aes") and
+    __builtin_cpu_supports("pclmul") and __builtin_cpu_supports("sse4.1");
+  const auto avx2 = sse and __builtin_cpu_supports("avx2") and
+    __builtin_cpu_supports("vaes") and __builtin_cpu_supports("vpclmulqdq");
+  const auto avx512 = avx2 and __builtin_cpu_supports("avx512f") and
+    __builtin_cpu_supports("avx512bw");
+  switch ( impl )
+  {
+    case cipher_impl::aesni:       return sse;
+    case cipher_impl::vaes_avx2:   return avx2;
+    case cipher_impl::vaes_avx512: return avx512;
+    default: break;
+  }
+#else
+  static_cast<void>( impl );
+#endif
+  return false;
+}
+
+std::optional<cipher_impl> gcm_kernel::best()
+{
+  for ( const auto impl : {cipher_impl::vaes_avx512, cipher_impl::vaes_avx2,
+         cipher_impl::aesni} )
+    if ( supported(impl) )
+      return impl;
+  return {};
+}
+
+std::string_view gcm_kernel::name( const cipher_impl impl )
+{
+  switch ( impl )
+  {
+    case cipher_impl::automatic:   return "auto";
+    case cipher_impl::libcrypto:   return "libcrypto";
+    case cipher_impl::aesni:       return "aesni";
+    case cipher_impl::vaes_avx2:   return "vaes-avx2";
+    case cipher_impl::vaes_avx512: return "vaes-avx512";
+  }
+  return "?";
+}
+
+std::optional<cipher_impl> gcm_kernel::choose( const cipher_impl impl )
+{
+  if ( impl == cipher_impl::automatic )
+    return best();
+  if ( impl == cipher_impl::libcrypto )
+    return {};
+  if ( not supported(impl) )
+  {
+    std::cerr << "error: cipher implementation "<< name(impl)
+      <<" isn't supported on this CPU or in this build\n";
+    throw see_stderr{};
+  }
+  return impl;
+}
+
+unsigned gcm_kernel::lanes( const cipher_impl impl )
+{
+  switch ( impl )
+  {
+    case cipher_impl::vaes_avx512: return 4;
+    case cipher_impl::vaes_avx2:   return 2;
+    default:                       return 1;
+  }
+}
+
+gcm_kernel::gcm_kernel( const cipher_impl impl )
+  : impl{impl}
+{
+  assert( supported(impl) );
+#ifdef UNAESGCM_X86_KERNEL
+  switch ( impl )
+  {
+    case cipher_impl::vaes_avx512:
+      bulk = x86::avx512::bulk, multi = x86::avx512::multi; break;
+    case cipher_impl::vaes_avx2:
+      bulk = x86::avx2::bulk,   multi = x86::avx2::multi;   break;
+    default:
+      bulk = x86::sse::bulk,    multi = x86::sse::multi;    break;
+  }
+#endif
+}
+
+#ifdef UNAESGCM_X86_KERNEL
+void gcm_kernel::set_key( const aes_key &key )
+{
+  x86::expand_key( s, data(key), size(key) );
+}
+
+void gcm_kernel::reset( const std::vector<byte> &iv )
+{
+  block H{};
+  x86::encrypt_block( s, H );
+  J0 = derive_j0( gf128::load(std::data(H)), std::data(iv), std::size(iv) );
+  E_J0 = J0;
+  x86::encrypt_block( s, E_J0 );
+  acc = {};
+  next_block = length = used = 0;
+}
+
+bool gcm_kernel::update( const bool decrypt,
+  const byte *in, byte *out, std::size_t n )
+{
+  if ( n > max_length - length )
+    return false;
+  length += n;
+
+  // continues the partial block with k bytes, hashing it once complete
+  const auto continue_partial = [&]( const std::size_t k )
+  {
+    for ( std::size_t i = 0; i < k; ++i )
+    {
+      const auto c = in[i];
+      out[i] = static_cast<byte>( c ^ keystream[used+i] );
+      partial[used+i] = decrypt ? c : out[i];
+    }
+    in += k, out += k, n -= k;
+    if ( (used += k) == block_size )
+    {
+      x86::ghash( s, acc, partial );
+      used = 0;
+    }
+  };
+
+  if ( used )
+    continue_partial( std::min(n, block_size-used) );
+  if ( const auto blocks = n / block_size )
+  {
+    // the powers for a batch of bulk(), if there's one
+    if ( const auto batch = 8*lanes(impl); blocks >= batch )
+      x86::extend_powers( s, batch );
+    bulk( s, counter_block(J0, next_block), acc, in, out, blocks, decrypt );
+    next_block += blocks;
+    in += blocks*block_size, out += blocks*block_size, n -= blocks*block_size;
+  }
+  if ( n )
+  {
+    keystream = counter_block( J0, next_block++ );
+    x86::encrypt_block( s, keystream );
+    continue_partial( n );
+  }
+  return true;
+}
+
+void gcm_kernel::update_lanes( const bool decrypt,
+  const std::span<gcm_kernel *const> kernels,
+  const byte *const in[], byte *const out[], const std::size_t blocks )
+{
+  const auto &first = *kernels.front();
+  assert( size(kernels) == lanes(first.impl) );
+  const gcm_kernel::schedule *s[4];
+  block counters[4], *counter[4], *acc[4];
+  for ( std::size_t l = 0; l < size(kernels); ++l )
+  {
+    auto &k = *kernels[l];
+    assert( k.impl == first.impl and k.s.rounds == first.s.rounds and
+      not k.used and blocks*block_size <= max_length - k.length );
+    if ( blocks >= 8 )
+      x86::extend_powers( k.s, 8 );
+    s[l] = &k.s;
+    counters[l] = counter_block( k.J0, k.next_block );
+    counter[l] = &counters[l];
+    acc[l] = &k.acc;
+    k.next_block += blocks;
+    k.length += blocks*block_size;
+  }
+  first.multi( s, counter, acc, in, out, blocks, decrypt );
+}
+
+gcm_tag gcm_kernel::finish()
+{
+  if ( used )
+  {
+    std::fill( begin(partial)+static_cast<std::ptrdiff_t>(used), end(partial),
+      byte{0} );
+    x86::ghash( s, acc, partial );
+    used = 0;
+  }
+  block lengths{};
+  const auto bits = length*byte_bits;
+  for ( auto i = 0u; i < 8; ++i )
+    lengths[15-i] = static_cast<byte>( bits >> 8*i );
+  x86::ghash( s, acc, lengths );
+
+  gcm_tag tag;
+  for ( auto i = 0u; i < tag_size; ++i )
+    tag[i] = acc[i] ^ E_J0[i];
+  return tag;
+}
+#else
+void gcm_kernel::update_lanes( bool, std::span<gcm_kernel *const>,
+  const byte *const [], byte *const [], std::size_t ) {}
+void gcm_kernel::set_key( const aes_key & ) {}
+void gcm_kernel::reset( const std::vector<byte> & ) {}
+bool gcm_kernel::update( bool, const byte *, byte *, std::size_t )
+{ return false; }
+gcm_tag gcm_kernel::finish() { return {}; }
+#endif
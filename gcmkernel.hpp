@@ -0,0 +1,84 @@
+#ifndef UNAESGCM_GCMKERNEL_HPP
+#define UNAESGCM_GCMKERNEL_HPP
+
+// An in-tree AES-GCM for x86-64, from AES-NI and carry-less multiplication,
+// at one, two or four blocks per vector register (SSE, AVX2 with VAES,
+// AVX-512 with VAES), with eight registers of blocks in flight and a single
+// GHASH reduction per eight. gcm_cipher uses it in place of libcrypto's where
+// the CPU allows (see engine_options::cipher); the out-of-order building
+// blocks of gcmparts.hpp still use libcrypto.
+
+#include "gcmparts.hpp"
+#include <span>
+
+using cipher_impl = engine_options::implementation;
+
+class gcm_kernel
+{
+public:
+  // round keys, and H^32..H^1 (byte-reversed), shared by all the widths;
+  // the powers are computed as far as they're needed, the last ones first
+  struct schedule
+  {
+    std::array<block,15> round_keys;
+    unsigned rounds;
+    std::array<block,32> h_powers{};
+    unsigned powers = 0;
+  };
+  // crypts whole blocks from the counter block given on, and GHASHes the
+  // ciphertext into acc
+  using bulk_fn = void (*)( const schedule &, const block &counter,
+    block &acc, const byte *in, byte *out, std::size_t blocks, bool decrypt );
+  // the same for one message per lane, under a schedule each
+  using multi_fn = void (*)( const schedule *const [],
+    block *const counter[], block *const acc[],
+    const byte *const in[], byte *const out[], std::size_t blocks,
+    bool decrypt );
+
+  static constexpr auto max_length =
+    ((std::uint64_t{1} << 32) - 2) * std::uint64_t{block_size};
+
+private:
+  cipher_impl impl;
+  bulk_fn bulk;
+  multi_fn multi;
+  schedule s;
+  block J0, E_J0, acc;
+  std::uint64_t next_block = 0, length = 0;
+  // the keystream of the current partial block, and its ciphertext so far
+  block keystream, partial;
+  std::size_t used = 0;
+
+public:
+  // the widest implementation this build and CPU support, if any
+  static std::optional<cipher_impl> best();
+  static bool supported( cipher_impl );
+  static std::string_view name( cipher_impl );
+  // what to use for the choice in engine_options, nothing for libcrypto;
+  // throws if a specific one was asked for but isn't supported
+  static std::optional<cipher_impl> choose( cipher_impl );
+  // how many messages update_lanes() takes at once
+  static unsigned lanes( cipher_impl );
+
+  // impl must be supported; the key and the IV are set by reset()
+  explicit gcm_kernel( cipher_impl );
+
+  void set_key( const aes_key & );
+  void reset( const std::vector<byte> &iv );
+
+  // in and out may be equal, but may not otherwise overlap; false once the
+  // message would exceed GCM's limit of 2^32-2 blocks
+  [[nodiscard]] bool update( bool decrypt,
+    const byte *in, byte *out, std::size_t n );
+
+  // Advances one message per lane (of kernels of the same implementation
+  // and key size, between whole blocks) by the same number of blocks, side
+  // by side in the vector registers.
+  static void update_lanes( bool decrypt,
+    std::span<gcm_kernel *const>, const byte *const in[], byte *const out[],
+    std::size_t blocks );
+
+  gcm_tag finish();
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "gcmparts.hpp"
+#include "overload.hpp"
+#include <openssl/crypto.h>
+#include <algorithm>
+#include <cassert>
+
+static void new_ctx( evp_cipher_ctx &ctx, const aes_key &key,
+  const EVP_CIPHER *const c256,
+  const EVP_CIPHER *const c192,
+  const EVP_CIPHER *const c128,
+  const byte *const iv = nullptr )
+{
+  ctx.reset( checked(EVP_CIPHER_CTX_new,()) );
+  const auto cipher = std::visit( overload
+  {
+    [&]( const std::array<byte,bits<256>> & ){ return c256; },
+    [&]( const std::array<byte,bits<192>> & ){ return c192; },
+    [&]( const std::array<byte,bits<128>> & ){ return c128; },
+  }, key );
+  checked(EVP_EncryptInit_ex,( ctx.get(), cipher, nullptr, data(key), iv ));
+}
+
+gcm_parts::gcm_parts( const std::vector<byte> &iv, const aes_key &key )
+  : key{&key}
+{
+  evp_cipher_ctx ecb;
+  new_ctx( ecb, key, EVP_aes_256_ecb(), EVP_aes_192_ecb(), EVP_aes_128_ecb() );
+  const auto E = [&]( const block &in )
+  {
+    block out;
+    int out_size;
+    checked(EVP_EncryptUpdate,( ecb.get(), std::data(out), &out_size,
+      std::data(in), block_size ));
+    return gf128::load( std::data(out) );
+  };
+
+  if ( std::empty(iv) )
+  {
+    std::cerr << "error: zero-length IV\n";
+    throw see_stderr{};
+  }
+
+  H = E( {} );
+  J0 = derive_j0( H, std::data(iv), std::size(iv) );
+  E_J0 = E( J0 );
+  E_gmac_J0 = E( {0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,1} );
+}
+
+gcm_tag gcm_parts::tag( const gf128 acc, const std::uint64_t total_bytes ) const
+{
+  const auto lengths = gf128{ 0, total_bytes*byte_bits };
+  return (E_J0 ^ acc ^ lengths*H).store();
+}
+
+bool gcm_parts::tags_equal( const gcm_tag &a, const gcm_tag &b )
+{
+  return CRYPTO_memcmp( std::data(a), std::data(b), tag_size ) == 0;
+}
+
+gcm_ctr::gcm_ctr( const gcm_parts &parts )
+  : parts{parts}
+{
+  new_ctx( ctx, *parts.key,
+    EVP_aes_256_ctr(), EVP_aes_192_ctr(), EVP_aes_128_ctr() );
+}
+
+void gcm_ctr::crypt( std::uint64_t block_index,
+  const byte *in, byte *out, std::size_t n )
+{
+  constexpr auto max_span = std::size_t{int_max_u} / block_size * block_size;
+  while ( n )
+  {
+    const auto ctr = parts.counter( block_index );
+    const auto to_wrap = blocks_to_wrap( parts.J0, block_index );
+    const auto span = static_cast<std::size_t>( std::min<std::uint64_t>(
+      {n, to_wrap*block_size, max_span} ));
+    checked(EVP_EncryptInit_ex,( ctx.get(),
+      nullptr, nullptr, nullptr, std::data(ctr) ));
+    int out_size;
+    checked(EVP_EncryptUpdate,( ctx.get(), out, &out_size,
+      in, static_cast<int>(span) ));
+    assert( static_cast<std::size_t>(out_size) == span );
+    block_index += span / block_size;
+    in  += span;
+    out += span;
+    n   -= span;
+  }
+}
+
+static constexpr block gmac_iv{};
+
+ghash_partial::ghash_partial( const gcm_parts &parts )
+  : parts{parts}
+{
+  new_ctx( ctx, *parts.key,
+    EVP_aes_256_gcm(), EVP_aes_192_gcm(), EVP_aes_128_gcm(),
+    std::data(gmac_iv) );
+}
+
+void ghash_partial::update( const byte *p, std::size_t n )
+{
+  len += n;
+  while ( n )
+  {
+    const auto span = std::min( n, std::size_t{int_max_u} );
+    int out_size;
+    checked(EVP_EncryptUpdate,( ctx.get(), nullptr, &out_size,
+      p, static_cast<int>(span) ));
+    p += span;
+    n -= span;
+  }
+}
+
+gf128 ghash_partial::finish()
+{
+  int zero;
+  checked(EVP_EncryptFinal_ex,( ctx.get(), nullptr, &zero ));
+  gcm_tag gmac;
+  checked(EVP_CIPHER_CTX_ctrl,( ctx.get(), EVP_CTRL_AEAD_GET_TAG,
+    tag_size, std::data(gmac) ));
+  checked(EVP_EncryptInit_ex,( ctx.get(),
+    nullptr, nullptr, nullptr, std::data(gmac_iv) ));
+
+  const auto lengths = gf128{ len*byte_bits, 0 };
+  len = 0;
+  return gf128::load(std::data(gmac)) ^ parts.E_gmac_J0 ^ lengths*parts.H;
+}
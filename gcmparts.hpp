@@ -0,0 +1,174 @@
+
+#ifndef UNAESGCM_GCMPARTS_HPP
+#define UNAESGCM_GCMPARTS_HPP
+
+// The building blocks of GCM, exposed so that a message can be processed out
+// of order (in segments, on several threads, from a checkpoint, etc.): the
+// field arithmetic of GHASH, the pre-counter block J0 and a positionable CTR.
+
+#include "engine.hpp"
+#include <cstdint>
+#include <algorithm>
+
+constexpr auto block_size = std::size_t{16};
+using block = std::array<byte,block_size>;
+
+// an element of GF(2^128), in GCM's reflected bit order
+struct gf128
+{
+  std::uint64_t hi = 0, lo = 0;
+
+  static constexpr gf128 load( const byte *const b )
+  {
+    gf128 r;
+    for ( auto i = 0u; i < 8; ++i )
+    {
+      r.hi = r.hi << 8 | b[i];
+      r.lo = r.lo << 8 | b[i+8];
+    }
+    return r;
+  }
+  constexpr block store() const
+  {
+    block b{};
+    for ( auto i = 0u; i < 8; ++i )
+    {
+      b[7 -i] = static_cast<byte>( hi >> 8*i );
+      b[15-i] = static_cast<byte>( lo >> 8*i );
+    }
+    return b;
+  }
+
+  constexpr friend gf128 operator^( const gf128 a, const gf128 b )
+  { return { a.hi^b.hi, a.lo^b.lo }; }
+  constexpr gf128 &operator^=( const gf128 o ) { return *this = *this ^ o; }
+  constexpr friend bool operator==( gf128, gf128 ) = default;
+
+  // SP 800-38D, algorithm 1, without data-dependent branches
+  constexpr friend gf128 operator*( const gf128 x, gf128 v )
+  {
+    gf128 z;
+    for ( auto i = 0u; i < 128; ++i )
+    {
+      const auto bit = i < 64 ? x.hi >> (63-i) : x.lo >> (127-i);
+      const auto take = std::uint64_t{0} - (bit & 1);
+      z.hi ^= v.hi & take;
+      z.lo ^= v.lo & take;
+      const auto carry = std::uint64_t{0} - (v.lo & 1);
+      v.lo = v.lo >> 1 | v.hi << 63;
+      v.hi = v.hi >> 1 ^ (std::uint64_t{0xe1} << 56 & carry);
+    }
+    return z;
+  }
+  constexpr gf128 &operator*=( const gf128 o ) { return *this = *this * o; }
+
+  static constexpr gf128 one() { return { std::uint64_t{1} << 63, 0 }; }
+
+  constexpr gf128 pow( std::uint64_t n ) const
+  {
+    auto r = one(), b = *this;
+    for ( ; n; n >>= 1, b *= b )
+      if ( n & 1 )
+        r *= b;
+    return r;
+  }
+};
+
+constexpr auto blocks_in( const std::uint64_t bytes )
+{ return (bytes + block_size-1) / block_size; }
+
+// the pre-counter block of SP 800-38D, given H = E_K(0^128)
+inline block derive_j0( const gf128 H, const byte *const iv,
+  const std::size_t iv_size )
+{
+  block J0{};
+  if ( iv_size == 12 )
+  {
+    std::copy_n( iv, iv_size, std::data(J0) );
+    J0.back() = 1;
+    return J0;
+  }
+  gf128 y;
+  for ( std::size_t off = 0; off < iv_size; off += block_size )
+  {
+    block x{};
+    std::copy_n( iv+off, std::min(block_size, iv_size-off), std::data(x) );
+    y = (y ^ gf128::load(std::data(x))) * H;
+  }
+  return ((y ^ gf128{0, std::uint64_t{iv_size}*byte_bits}) * H).store();
+}
+
+constexpr std::uint32_t low32( const block &b )
+{
+  return std::uint32_t{b[12]}<<24 | std::uint32_t{b[13]}<<16 |
+         std::uint32_t{b[14]}<< 8 | std::uint32_t{b[15]};
+}
+
+// the counter block of the data block with the given 0-based index, that is,
+// J0 with inc32 applied block_index+1 times
+constexpr block counter_block( const block &J0, const std::uint64_t block_index )
+{
+  const auto ctr = static_cast<std::uint32_t>( low32(J0) + 1 + block_index );
+  auto b = J0;
+  for ( auto i = 0u; i < 4; ++i )
+    b[15-i] = static_cast<byte>( ctr >> 8*i );
+  return b;
+}
+
+// Plain CTR, such as libcrypto's, carries into the upper 96 bits, GCM's
+// doesn't: a run of blocks sharing one plain-CTR invocation may not extend
+// past the 32-bit wraparound. This is how many blocks it may have at most.
+constexpr std::uint64_t blocks_to_wrap( const block &J0,
+  const std::uint64_t block_index )
+{
+  return (std::uint64_t{1} << 32) - low32( counter_block(J0, block_index) );
+}
+
+// Key- and IV-derived constants of one message. A "partial" GHASH of a run of
+// whole blocks A_1..A_m is the sum of A_i*H^(m-i+2); partials of consecutive
+// runs chain as acc*H^m ^ partial, and tag() closes the resulting chain.
+struct gcm_parts
+{
+  gf128 H;
+  block J0;
+  gf128 E_J0;       // E_K(J0)
+  gf128 E_gmac_J0;  // E_K(0^96||1), used by ghash_partial
+  const aes_key *key;
+
+  gcm_parts( const std::vector<byte> &iv, const aes_key & );
+
+  block counter( const std::uint64_t block_index ) const
+  { return counter_block( J0, block_index ); }
+
+  gcm_tag tag( gf128 acc, std::uint64_t total_bytes ) const;
+
+  static bool tags_equal( const gcm_tag &, const gcm_tag & );
+};
+
+// the GCM flavor of AES-CTR, positionable at any block of a message
+class gcm_ctr
+{
+  evp_cipher_ctx ctx;
+  const gcm_parts &parts;
+public:
+  explicit gcm_ctr( const gcm_parts & );
+  // in and out may be equal, but may not otherwise overlap
+  void crypt( std::uint64_t block_index,
+    const byte *in, byte *out, std::size_t n );
+};
+
+// GHASH over a run of data, computed by libcrypto as GMAC of the data as AAD
+class ghash_partial
+{
+  evp_cipher_ctx ctx;
+  const gcm_parts &parts;
+  std::uint64_t len = 0;
+public:
+  explicit ghash_partial( const gcm_parts & );
+  // a run that isn't the last of a message must span whole blocks
+  void update( const byte *, std::size_t );
+  // returns the partial of everything since the previous finish(), if any
+  gf128 finish();
+};
+
+#endif
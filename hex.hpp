@@ -70,6 +70,17 @@ auto &dump_hex( Stream &out, const Cont &octets )
   return out;
 }
 
+// plain lowercase digits, as IVs and keys are written
+template<typename Cont>
+inline std::string to_hex( const Cont &octets )
+{
+  constexpr auto digits = "0123456789abcdef";
+  std::string s;
+  for ( const byte o : octets )
+    s += {digits[o >> digit_bits], digits[o & 0xf]};
+  return s;
+}
+
 // i/o manipulator (kinda)
 template<typename Container>
 class hexed
@@ -0,0 +1,386 @@
+#include "sidecar.hpp"
+#include "alignedbuf.hpp"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <sys/stat.h>
+
+// The GHASH chain over a ciphertext at every so many bytes (whole blocks),
+// the counter position there being the offset in blocks. Kept as text:
+//
+//   unaesgcm-index 1
+//   every 16777216
+//   size 53687091200
+//   ghash 16777216 <32 hex digits>
+//   ghash 33554432 <32 hex digits>
+//   ...
+//   mac <64 hex digits>
+//
+// with a GHASH line for every multiple of `every` short of the size, where
+// the MAC, if any, is HMAC-SHA256, under the AES key, of the IV and the rest.
+// As with a checkpoint, the GHASHes give away H to anyone with the
+// ciphertext: an index mustn't be shared, and only a MACed one vouches for
+// anything on its own.
+struct gcm_index
+{
+  std::uint64_t every = 0, size = 0;
+  std::vector<gf128> accs = {};
+  bool macked = false;
+
+  static constexpr std::string_view magic = "unaesgcm-index 1";
+
+  std::uint64_t segments() const { return std::size(accs) + 1; }
+  std::uint64_t segment_start( const std::uint64_t k ) const
+  { return k*every; }
+  std::uint64_t segment_end( const std::uint64_t k ) const
+  { return k+1 < segments() ? (k+1)*every : size; }
+  // the chain up to the start of a segment
+  gf128 acc_before( const std::uint64_t k ) const
+  { return k ? accs[k-1] : gf128{}; }
+
+  sidecar_mac::value_type mac( const std::vector<byte> &iv,
+    const aes_key &key ) const
+  {
+    sidecar_mac m{magic, iv};
+    m << every << size;
+    for ( const auto &acc : accs )
+      m << acc.store();
+    return m.of( key );
+  }
+
+  // throws unless it's an index of this IV and key
+  static gcm_index load( const char *const path,
+    const std::vector<byte> &iv, const aes_key &key )
+  {
+    std::ifstream in{path};
+    if ( not in )
+      sys_failed( "open", path );
+    gcm_index x;
+    std::string line, word, hex;
+    std::getline( in, line );
+    auto ok = line == magic and
+      in >> word and word == "every" and in >> x.every and
+      in >> word and word == "size" and in >> x.size and
+      x.every and x.every % block_size == 0;
+    try
+    {
+      while ( ok and in >> word and word == "ghash" )
+      {
+        std::uint64_t at;
+        ok = in >> at >> hex and std::size(hex) == 2*block_size and
+          at == (std::size(x.accs)+1) * x.every and at < x.size;
+        if ( ok )
+          x.accs.push_back( gf128::load( std::data( parse_hex(
+            std::data(hex), block{}, "GHASH" ) ) ) );
+      }
+      ok = ok and std::size(x.accs) == (std::max(x.size, std::uint64_t{1})
+        - 1) / x.every;
+      if ( ok and in and word == "mac" and in >> hex )
+      {
+        ok = sidecar_mac::matches( hex, x.mac(iv, key) );
+        x.macked = true;
+      }
+      else
+        ok = ok and not in and in.eof();
+    }
+    catch ( const std::runtime_error & )
+    {
+      ok = false;
+    }
+    if ( ok )
+      return x;
+    std::cerr << "error: '"<< path <<"' is no index of this IV and key\n";
+    throw see_stderr{};
+  }
+
+  void save( const char *const path,
+    const std::vector<byte> &iv, const aes_key &key ) const
+  {
+    std::ostringstream text;
+    text << magic <<'\n'
+      << "every "<< every <<'\n'
+      << "size "<< size <<'\n';
+    for ( auto k = 0u; k < std::size(accs); ++k )
+      text << "ghash "<< (k+1)*every <<' '<< to_hex(accs[k].store()) <<'\n';
+    if ( macked )
+      text << "mac "<< to_hex(mac(iv, key)) <<'\n';
+    sidecar_save( path, text.str() );
+  }
+};
+
+void aesgcm_indexed(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const char *const index_path, const std::uint64_t every, const bool mac,
+  const engine_options &opts )
+{
+  using std::data;
+
+  if ( not every or every % block_size )
+  {
+    std::cerr << "error: index interval not a multiple of "<< block_size
+      <<" bytes\n";
+    throw see_stderr{};
+  }
+  const gcm_parts parts{iv, key};
+  const unique_fd in{ ::open(in_path, O_RDONLY|O_CLOEXEC) };
+  if ( not in )
+    sys_failed( "open", in_path );
+  const unique_fd out{ ::open(out_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,
+    0666) };
+  if ( not out )
+    sys_failed( "open", out_path );
+
+  // whole blocks at a time, none straddling a point of the index
+  const auto chunk = static_cast<std::size_t>( std::min<std::uint64_t>(
+    std::max(checked_buffer_size(opts) / block_size, std::size_t{1}) *
+    block_size, every ) );
+  const alignedbuf<byte> buf( chunk );
+  ghash_partial ghash{parts};
+  gcm_ctr ctr{parts};
+  const auto H_chunk = parts.H.pow( chunk/block_size );
+
+  engine_stats stats{ .backend = "indexed", .chunk_size = chunk,
+    .timing = opts.stats_fd >= 0 };
+  gcm_index index{ .every = every, .macked = mac };
+  gf128 acc;
+  for ( std::uint64_t pos = 0;; )
+  {
+    const auto want = static_cast<std::size_t>(
+      std::min<std::uint64_t>( chunk, every - pos%every ) );
+    const auto got = [&]
+    {
+      const auto timed = stats.time( stats.read_wait );
+      return read_fully( in.get(), data(buf), want );
+    }();
+    stats.bytes_read += got;
+    {
+      const auto timed = stats.time( stats.crypto );
+      ctr.crypt( pos/block_size, data(buf), data(buf), got );
+      ghash.update( data(buf), got );
+      acc = acc * (got == chunk ? H_chunk : parts.H.pow(blocks_in(got))) ^
+        ghash.finish();
+      stats.cipher_calls += 2;
+      stats.bytes_processed += got;
+    }
+    {
+      const auto timed = stats.time( stats.write_wait );
+      write_fully( out.get(), data(buf), got );
+      stats.bytes_written += got;
+    }
+    pos += got;
+    if ( got != want )  // eof
+    {
+      // a point right at the end is none: the tag closes the chain there
+      if ( not got and not std::empty(index.accs) and
+           pos == std::size(index.accs) * every )
+        index.accs.pop_back();
+      index.size = pos;
+      break;
+    }
+    if ( pos % every == 0 )
+      index.accs.push_back( acc );
+  }
+  const auto tag = parts.tag( acc, index.size );
+  {
+    const auto timed = stats.time( stats.write_wait );
+    write_fully( out.get(), data(tag), tag_size );
+    stats.bytes_written += tag_size;
+  }
+  if ( opts.verbose )
+    log_result( encrypt, index.size, tag );
+  index.save( index_path, iv, key );
+  emit_stats( stats, opts, encrypt, in_path );
+}
+
+// the ciphertext of a regular file, mapped, and its tag
+struct sealed_file
+{
+  unique_fd fd;
+  mapping body;
+  gcm_tag tag;
+
+  sealed_file( const char *const path, const std::uint64_t body_size )
+    : fd{ ::open(path, O_RDONLY|O_CLOEXEC) }
+  {
+    if ( not fd )
+      sys_failed( "open", path );
+    struct stat st;
+    if ( ::fstat(fd.get(), &st) )
+      sys_failed( "stat", path );
+    if ( not S_ISREG(st.st_mode) or
+         static_cast<std::uint64_t>(st.st_size) != body_size + tag_size )
+    {
+      std::cerr << "error: '"<< path <<"' isn't of the size the index says\n";
+      throw see_stderr{};
+    }
+    body = mapping{ fd.get(), static_cast<std::size_t>(body_size), PROT_READ,
+      path };
+    if ( ::pread( fd.get(), std::data(tag), tag_size,
+           static_cast<off_t>(body_size) ) != ssize_t{tag_size} )
+      sys_failed( "pread", path );
+  }
+};
+
+// whether a segment of the ciphertext leads from the chain before it to the
+// chain after it, or to the tag
+static bool segment_authentic( const gcm_parts &parts, const gcm_index &index,
+  const sealed_file &file, const std::uint64_t k, const std::size_t chunk )
+{
+  ghash_partial ghash{parts};
+  const auto start = index.segment_start(k), end = index.segment_end(k);
+  for ( auto off = start; off < end; )
+  {
+    const auto n = static_cast<std::size_t>(
+      std::min<std::uint64_t>(chunk, end-off) );
+    ghash.update( std::data(file.body)+off, n );
+    off += n;
+  }
+  const auto acc = index.acc_before(k) * parts.H.pow(blocks_in(end-start)) ^
+    ghash.finish();
+  return k+1 < index.segments() ? acc == index.accs[k] :
+    gcm_parts::tags_equal( parts.tag(acc, index.size), file.tag );
+}
+
+std::vector<std::uint64_t> unaesgcm_check_index(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const index_path,
+  const engine_options &opts )
+{
+  const gcm_parts parts{iv, key};
+  const auto index = gcm_index::load( index_path, iv, key );
+  if ( not index.macked )
+    std::clog << "warning: '"<< index_path <<"' has no MAC; which segments"
+      " fail is only a hint, and only whether any do (the check against the"
+      " tag) counts\n";
+  const sealed_file file{ in_path, index.size };
+  file.body.advise( MADV_SEQUENTIAL );
+  const auto chunk = checked_buffer_size(opts) / block_size * block_size;
+
+  engine_stats stats{ .backend = "index", .chunk_size = chunk,
+    .bytes_read = index.size + tag_size, .timing = opts.stats_fd >= 0 };
+  std::vector<char> authentic( index.segments() );
+  {
+    // segments handed out one at a time, to as many threads as there are
+    const auto timed = stats.time( stats.crypto );
+    std::atomic<std::uint64_t> next = 0;
+    std::vector<std::exception_ptr> failures( index.segments() );
+    const auto work = [&]() noexcept
+    {
+      for ( std::uint64_t k; (k = next++) < index.segments(); )
+        try
+        {
+          authentic[k] = segment_authentic( parts, index, file, k, chunk );
+        }
+        catch ( ... )
+        {
+          failures[k] = std::current_exception();
+        }
+    };
+    const auto threads = std::min<std::uint64_t>( index.segments(),
+      std::max( 1u, opts.threads ? opts.threads :
+        std::thread::hardware_concurrency() ) );
+    {
+      std::vector<std::jthread> workers;
+      for ( auto t = std::uint64_t{1}; t < threads; ++t )
+        workers.emplace_back( work );
+      work();
+    }
+    for ( const auto &f : failures )
+      if ( f )
+        std::rethrow_exception( f );
+    stats.cipher_calls = index.segments();
+    stats.bytes_processed = index.size;
+  }
+
+  if ( opts.verbose )
+    log_result( decrypt, index.size, file.tag );
+  std::vector<std::uint64_t> failed;
+  for ( auto k = std::uint64_t{0}; k < index.segments(); ++k )
+    if ( not authentic[k] )
+    {
+      failed.push_back( k );
+      if ( opts.verbose )
+        std::clog << "segment "<< k <<" (bytes "<< index.segment_start(k)
+          <<" to "<< index.segment_end(k) <<") not authentic\n";
+    }
+  emit_stats( stats, opts, decrypt, in_path, std::empty(failed) );
+  return failed;
+}
+
+bool unaesgcm_range_indexed(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const char *const index_path,
+  std::uint64_t offset, std::uint64_t length,
+  const engine_options &opts )
+{
+  using std::data;
+
+  const gcm_parts parts{iv, key};
+  const auto index = gcm_index::load( index_path, iv, key );
+  if ( not index.macked )
+  {
+    std::cerr << "error: '"<< index_path <<"' has no MAC to vouch for a"
+      " range with\n";
+    throw see_stderr{};
+  }
+  const sealed_file file{ in_path, index.size };
+  offset = std::min( offset, index.size );
+  length = std::min( length, index.size - offset );
+  const auto chunk = std::max( checked_buffer_size(opts) / block_size,
+    std::size_t{1} ) * block_size;
+  engine_stats stats{ .backend = "index", .chunk_size = chunk,
+    .timing = opts.stats_fd >= 0 };
+
+  // the segments the window touches, and only those, are checked first
+  const auto first = offset / index.every;
+  const auto last = length ? (offset+length-1) / index.every : first;
+  for ( auto k = first; k <= last and k < index.segments(); ++k )
+  {
+    const auto timed = stats.time( stats.crypto );
+    ++stats.cipher_calls;
+    stats.bytes_read += index.segment_end(k) - index.segment_start(k);
+    stats.bytes_processed += index.segment_end(k) - index.segment_start(k);
+    if ( not segment_authentic( parts, index, file, k, chunk ) )
+    {
+      if ( opts.verbose )
+        std::clog << "segment "<< k <<" (bytes "<< index.segment_start(k)
+          <<" to "<< index.segment_end(k) <<") not authentic\n";
+      emit_stats( stats, opts, decrypt, in_path, false );
+      return false;
+    }
+  }
+
+  const unique_fd out{ ::open(out_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,
+    0666) };
+  if ( not out )
+    sys_failed( "open", out_path );
+  gcm_ctr ctr{parts};
+  const alignedbuf<byte> buf( chunk );
+  const auto head = offset % block_size;
+  for ( auto pos = offset - head, end = offset + length; pos < end; )
+  {
+    const auto n = static_cast<std::size_t>(
+      std::min<std::uint64_t>(chunk, end-pos) );
+    {
+      const auto timed = stats.time( stats.crypto );
+      ctr.crypt( pos/block_size, data(file.body)+pos, data(buf), n );
+      ++stats.cipher_calls;
+    }
+    const auto skip = pos < offset ? head : 0;
+    {
+      const auto timed = stats.time( stats.write_wait );
+      write_fully( out.get(), data(buf)+skip, n-skip );
+      stats.bytes_written += n-skip;
+    }
+    pos += n;
+  }
+  if ( opts.verbose )
+    std::clog << "bytes "<< offset <<" to "<< offset+length
+      <<" of the plaintext authenticated by the index\n";
+  emit_stats( stats, opts, decrypt, in_path, true );
+  return true;
+}
@@ -0,0 +1,192 @@
+#define UNAESGCM_BUILDING
+#include "unaesgcm.h"
+#include "gcmparts.hpp"
+#include <openssl/evp.h>
+#include <climits>
+#include <new>
+
+struct unaesgcm_ctx
+{
+  EVP_CIPHER_CTX *evp;
+  enum class state { fresh, busy, done } st = state::fresh;
+  bool decrypt = false;
+  // in range mode, the CTR position and how far it is from a wraparound
+  bool ranged = false;
+  block J0{};
+  std::uint64_t pos = 0, run_left = 0;
+};
+
+namespace
+{
+  const EVP_CIPHER *pick( const size_t key_len,
+    const EVP_CIPHER *const c256,
+    const EVP_CIPHER *const c192,
+    const EVP_CIPHER *const c128 )
+  {
+    return key_len == 32 ? c256 : key_len == 24 ? c192 :
+      key_len == 16 ? c128 : nullptr;
+  }
+
+  // restarts the CTR at the block pos is in, which must be its first byte
+  // unless this is the start of the range
+  bool restart_ctr( unaesgcm_ctx &ctx )
+  {
+    const auto index = ctx.pos / block_size;
+    const auto ctr = counter_block( ctx.J0, index );
+    ctx.run_left =
+      blocks_to_wrap(ctx.J0, index)*block_size - ctx.pos % block_size;
+    if ( EVP_EncryptInit_ex(ctx.evp, nullptr, nullptr, nullptr,
+           std::data(ctr)) != 1 )
+      return false;
+    // discard the keystream before pos
+    byte skip[block_size]{};
+    int n;
+    const auto head = static_cast<int>( ctx.pos % block_size );
+    return not head or
+      EVP_EncryptUpdate(ctx.evp, skip, &n, skip, head) == 1;
+  }
+}
+
+unaesgcm_ctx *unaesgcm_new( void )
+{
+  const auto evp = EVP_CIPHER_CTX_new();
+  if ( not evp )
+    return nullptr;
+  const auto ctx = new (std::nothrow) unaesgcm_ctx{evp};
+  if ( not ctx )
+    EVP_CIPHER_CTX_free( evp );
+  return ctx;
+}
+
+void unaesgcm_free( unaesgcm_ctx *const ctx )
+{
+  if ( ctx )
+    EVP_CIPHER_CTX_free( ctx->evp );
+  delete ctx;
+}
+
+int unaesgcm_init( unaesgcm_ctx *const ctx, const int decrypt,
+  const uint8_t *const key, const size_t key_len,
+  const uint8_t *const iv, const size_t iv_len )
+{
+  if ( not ctx or not key or not iv or not iv_len or iv_len > INT_MAX )
+    return UNAESGCM_BAD_ARGUMENT;
+  const auto cipher = pick( key_len,
+    EVP_aes_256_gcm(), EVP_aes_192_gcm(), EVP_aes_128_gcm() );
+  if ( not cipher )
+    return UNAESGCM_BAD_ARGUMENT;
+
+  ctx->st = unaesgcm_ctx::state::fresh;
+  ctx->decrypt = decrypt;
+  ctx->ranged = false;
+  if ( EVP_CipherInit_ex(ctx->evp, cipher, nullptr, nullptr, nullptr,
+         not decrypt) != 1 or
+       EVP_CIPHER_CTX_ctrl(ctx->evp, EVP_CTRL_GCM_SET_IVLEN,
+         static_cast<int>(iv_len), nullptr) != 1 or
+       EVP_CipherInit_ex(ctx->evp, nullptr, nullptr, key, iv, -1) != 1 )
+    return UNAESGCM_CRYPTO_FAILED;
+  ctx->st = unaesgcm_ctx::state::busy;
+  return UNAESGCM_OK;
+}
+
+int unaesgcm_init_range( unaesgcm_ctx *const ctx,
+  const uint8_t *const key, const size_t key_len,
+  const uint8_t *const iv, const size_t iv_len,
+  const uint64_t offset )
+{
+  if ( not ctx or not key or not iv or not iv_len )
+    return UNAESGCM_BAD_ARGUMENT;
+  const auto ecb = pick( key_len,
+    EVP_aes_256_ecb(), EVP_aes_192_ecb(), EVP_aes_128_ecb() );
+  const auto ctr = pick( key_len,
+    EVP_aes_256_ctr(), EVP_aes_192_ctr(), EVP_aes_128_ctr() );
+  if ( not ecb or not ctr )
+    return UNAESGCM_BAD_ARGUMENT;
+
+  ctx->st = unaesgcm_ctx::state::fresh;
+  ctx->decrypt = true;
+  ctx->ranged = true;
+  block H{};
+  int n;
+  if ( EVP_EncryptInit_ex(ctx->evp, ecb, nullptr, key, nullptr) != 1 or
+       EVP_EncryptUpdate(ctx->evp, std::data(H), &n,
+         std::data(H), block_size) != 1 )
+    return UNAESGCM_CRYPTO_FAILED;
+  ctx->J0 = derive_j0( gf128::load(std::data(H)), iv, iv_len );
+  ctx->pos = offset;
+  if ( EVP_EncryptInit_ex(ctx->evp, ctr, nullptr, key, nullptr) != 1 or
+       not restart_ctr(*ctx) )
+    return UNAESGCM_CRYPTO_FAILED;
+  ctx->st = unaesgcm_ctx::state::busy;
+  return UNAESGCM_OK;
+}
+
+int unaesgcm_update( unaesgcm_ctx *const ctx,
+  const uint8_t *in, size_t in_len,
+  uint8_t *out, const size_t out_cap, size_t *const out_len )
+{
+  if ( not ctx or not out_len or (in_len and (not in or not out)) )
+    return UNAESGCM_BAD_ARGUMENT;
+  *out_len = 0;
+  if ( ctx->st != unaesgcm_ctx::state::busy )
+    return UNAESGCM_BAD_STATE;
+  if ( out_cap < in_len )
+    return UNAESGCM_BUFFER_TOO_SMALL;
+  while ( in_len )
+  {
+    auto n = in_len < INT_MAX ? static_cast<int>(in_len) : INT_MAX;
+    if ( ctx->ranged )
+    {
+      if ( not ctx->run_left and not restart_ctr(*ctx) )
+        return UNAESGCM_CRYPTO_FAILED;
+      if ( ctx->run_left < static_cast<std::uint64_t>(n) )
+        n = static_cast<int>( ctx->run_left );
+      ctx->run_left -= static_cast<std::uint64_t>(n);
+      ctx->pos      += static_cast<std::uint64_t>(n);
+    }
+    int done;
+    if ( EVP_CipherUpdate(ctx->evp, out, &done, in, n) != 1 or done != n )
+      return UNAESGCM_CRYPTO_FAILED;
+    in += n; out += n; in_len -= static_cast<size_t>(n);
+    *out_len += static_cast<size_t>(n);
+  }
+  return UNAESGCM_OK;
+}
+
+int unaesgcm_finalize( unaesgcm_ctx *const ctx,
+  uint8_t tag[UNAESGCM_TAG_SIZE] )
+{
+  if ( not ctx or not tag )
+    return UNAESGCM_BAD_ARGUMENT;
+  if ( ctx->st != unaesgcm_ctx::state::busy )
+    return UNAESGCM_BAD_STATE;
+  ctx->st = unaesgcm_ctx::state::done;
+  if ( ctx->ranged )
+    return UNAESGCM_UNAUTHENTICATED;
+  int zero;
+  if ( not ctx->decrypt )
+    return EVP_CipherFinal_ex(ctx->evp, nullptr, &zero) == 1 and
+      EVP_CIPHER_CTX_ctrl(ctx->evp, EVP_CTRL_AEAD_GET_TAG,
+        UNAESGCM_TAG_SIZE, tag) == 1 ? UNAESGCM_OK : UNAESGCM_CRYPTO_FAILED;
+  if ( EVP_CIPHER_CTX_ctrl(ctx->evp, EVP_CTRL_GCM_SET_TAG,
+         UNAESGCM_TAG_SIZE, tag) != 1 )
+    return UNAESGCM_CRYPTO_FAILED;
+  return EVP_CipherFinal_ex(ctx->evp, nullptr, &zero) == 1 ?
+    UNAESGCM_OK : UNAESGCM_AUTH_FAILED;
+}
+
+const char *unaesgcm_strerror( const int status )
+{
+  switch ( status )
+  {
+    case UNAESGCM_OK:               return "success";
+    case UNAESGCM_AUTH_FAILED:      return "authentication failed";
+    case UNAESGCM_UNAUTHENTICATED:  return "not authenticated";
+    case UNAESGCM_BAD_ARGUMENT:     return "bad argument";
+    case UNAESGCM_BUFFER_TOO_SMALL: return "output buffer too small";
+    case UNAESGCM_BAD_STATE:        return "not initialized or already finalized";
+    case UNAESGCM_CRYPTO_FAILED:    return "libcrypto failure";
+    case UNAESGCM_OUT_OF_MEMORY:    return "out of memory";
+    default:                        return "unknown status";
+  }
+}
@@ -0,0 +1,77 @@
+
+#ifndef UNAESGCM_LIBUNAESGCM_HPP
+#define UNAESGCM_LIBUNAESGCM_HPP
+
+// a thin C++ veneer over unaesgcm.h
+
+#include "unaesgcm.h"
+#include <span>
+#include <array>
+#include <memory>
+#include <cstdint>
+
+namespace libunaesgcm
+{
+  enum class status : int
+  {
+    ok               = UNAESGCM_OK,
+    auth_failed      = UNAESGCM_AUTH_FAILED,
+    unauthenticated  = UNAESGCM_UNAUTHENTICATED,
+    bad_argument     = UNAESGCM_BAD_ARGUMENT,
+    buffer_too_small = UNAESGCM_BUFFER_TOO_SMALL,
+    bad_state        = UNAESGCM_BAD_STATE,
+    crypto_failed    = UNAESGCM_CRYPTO_FAILED,
+    out_of_memory    = UNAESGCM_OUT_OF_MEMORY,
+  };
+
+  inline const char *to_string( const status s )
+  { return unaesgcm_strerror( static_cast<int>(s) ); }
+
+  using tag = std::array<std::uint8_t,UNAESGCM_TAG_SIZE>;
+
+  class context
+  {
+    struct deleter
+    { void operator()( unaesgcm_ctx *const c ) const { unaesgcm_free(c); } };
+    std::unique_ptr<unaesgcm_ctx,deleter> ctx{ unaesgcm_new() };
+
+  public:
+    // check valid() (or the status of init()) for allocation failure
+    bool valid() const { return bool{ctx}; }
+
+    status init( const bool decrypt,
+      const std::span<const std::uint8_t> key,
+      const std::span<const std::uint8_t> iv )
+    {
+      if ( not ctx )
+        return status::out_of_memory;
+      return status{ unaesgcm_init( ctx.get(), decrypt,
+        key.data(), key.size(), iv.data(), iv.size() ) };
+    }
+
+    // decryption of a window starting at the offset, unauthenticated
+    status init_range(
+      const std::span<const std::uint8_t> key,
+      const std::span<const std::uint8_t> iv, const std::uint64_t offset )
+    {
+      if ( not ctx )
+        return status::out_of_memory;
+      return status{ unaesgcm_init_range( ctx.get(),
+        key.data(), key.size(), iv.data(), iv.size(), offset ) };
+    }
+
+    // on success, out_len equals in.size()
+    status update( const std::span<const std::uint8_t> in,
+      const std::span<std::uint8_t> out, std::size_t &out_len )
+    {
+      return status{ unaesgcm_update( ctx.get(),
+        in.data(), in.size(), out.data(), out.size(), &out_len ) };
+    }
+
+    // encrypting, fills t; decrypting, checks it
+    status finalize( tag &t )
+    { return status{ unaesgcm_finalize( ctx.get(), t.data() ) }; }
+  };
+}
+
+#endif
@@ -1,7 +1,53 @@
-
 #include "aesgcm.hpp"
 #include "basename.hpp"
 #include <iostream>
+#include <fstream>
+#include <charconv>
+#include <algorithm>
+#include <thread>
+#include <csignal>
+
+// a non-negative integer optionally followed by a binary multiple suffix
+static std::size_t parse_size( const std::string_view s )
+{
+  std::size_t n;
+  const auto [end, ec] = std::from_chars( s.data(), s.data()+s.size(), n );
+  auto shift = 0u;
+  if ( end != s.data()+s.size() )
+  {
+    const auto suffix = std::string_view{end,
+      static_cast<std::size_t>(s.data()+s.size()-end)};
+         if ( suffix == "K" ) shift = 10;
+    else if ( suffix == "M" ) shift = 20;
+    else if ( suffix == "G" ) shift = 30;
+    else shift = ~0u;
+  }
+  if ( ec != std::errc{} or shift == ~0u or
+    n > (std::numeric_limits<std::size_t>::max() >> shift) )
+    throw std::runtime_error{"bad size: "+ std::string{s}};
+  return n << shift;
+}
+
+// a plain non-negative int
+static int parse_fd( const std::string_view s )
+{
+  int fd;
+  const auto [end, ec] = std::from_chars( s.data(), s.data()+s.size(), fd );
+  if ( ec != std::errc{} or end != s.data()+s.size() or fd < 0 )
+    throw std::runtime_error{"bad file descriptor: "+ std::string{s}};
+  return fd;
+}
+
+static engine_options::implementation parse_cipher( const std::string_view s )
+{
+  using impl = engine_options::implementation;
+       if ( s == "auto"        ) return impl::automatic;
+  else if ( s == "libcrypto"   ) return impl::libcrypto;
+  else if ( s == "aesni"       ) return impl::aesni;
+  else if ( s == "vaes-avx2"   ) return impl::vaes_avx2;
+  else if ( s == "vaes-avx512" ) return impl::vaes_avx512;
+  throw std::runtime_error{"unknown cipher implementation: "+ std::string{s}};
+}
 
 int main( const int argc, const char *const *const argv )
 {
@@ -9,23 +55,335 @@ int main( const int argc, const char *const *const argv )
   const auto bn = basename( argc ? argv[0] : "" );
   if ( bn ==   "aesgcm-real" ) decrypt_maybe = false;
   if ( bn == "unaesgcm-real" ) decrypt_maybe = true;
-  if ( not decrypt_maybe or argc != 2 )
+
+  engine_options opts;
+  std::optional<std::string> batch, daemon;
+  std::optional<std::uint64_t> offset, length;
+  std::optional<std::string> checkpoint, fetch, upload, index;
+  std::uint64_t index_every = std::uint64_t{16} << 20;
+  bool index_mac = true;
+  unsigned connections = 4;
+  bool transcrypt = false;
+  std::vector<std::string_view> args;
+  for ( auto i = 1; i < argc; ++i )
+  {
+    const auto arg = std::string_view{argv[i]};
+    if ( constexpr std::string_view o = "--buffer-size="; arg.starts_with(o) )
+      opts.buffer_size = parse_size( arg.substr(size(o)) );
+    else if ( constexpr std::string_view o = "--threads="; arg.starts_with(o) )
+      opts.threads = static_cast<unsigned>(
+        std::min( parse_size(arg.substr(size(o))), std::size_t{1024} ) );
+    else if ( arg == "--verify-first" )
+      opts.verify = engine_options::verification::first;
+    else if ( arg == "--pipelined" )
+      opts.pipelined = true;
+    else if ( arg == "--io-uring" )
+      opts.io_uring = true;
+    else if ( constexpr std::string_view o = "--cipher="; arg.starts_with(o) )
+      opts.cipher = parse_cipher( arg.substr(size(o)) );
+    else if ( arg == "--drop-cache" )
+      opts.out_cache = engine_options::output_cache::drop;
+    else if ( arg == "--direct-io" )
+      opts.out_cache = engine_options::output_cache::direct;
+    else if ( arg == "--keep-unauthentic" )
+      opts.keep_unauthentic = true;
+    else if ( constexpr std::string_view o = "--hash="; arg.starts_with(o) )
+      opts.hashes.emplace_back( arg.substr(size(o)) );
+    else if ( arg == "--stats" )
+      opts.stats_fd = 2;
+    else if ( constexpr std::string_view o = "--stats="; arg.starts_with(o) )
+      opts.stats_fd = parse_fd( arg.substr(size(o)) );
+    else if ( constexpr std::string_view o = "--checkpoint=";
+              arg.starts_with(o) )
+      checkpoint = arg.substr(size(o));
+    else if ( constexpr std::string_view o = "--fetch="; arg.starts_with(o) )
+      fetch = arg.substr(size(o));
+    else if ( constexpr std::string_view o = "--upload="; arg.starts_with(o) )
+      upload = arg.substr(size(o));
+    else if ( constexpr std::string_view o = "--connections=";
+              arg.starts_with(o) )
+      connections = static_cast<unsigned>(
+        std::min( parse_size(arg.substr(size(o))), std::size_t{64} ) );
+    else if ( constexpr std::string_view o = "--index="; arg.starts_with(o) )
+      index = arg.substr(size(o));
+    else if ( constexpr std::string_view o = "--index-every=";
+              arg.starts_with(o) )
+      index_every = parse_size( arg.substr(size(o)) );
+    else if ( arg == "--index-no-mac" )
+      index_mac = false;
+    else if ( arg == "--transcrypt" )
+      transcrypt = true;
+    else if ( arg == "--verify-only" )
+      opts.verify = engine_options::verification::only;
+    else if ( constexpr std::string_view o = "--offset="; arg.starts_with(o) )
+      offset = parse_size( arg.substr(size(o)) );
+    else if ( constexpr std::string_view o = "--length="; arg.starts_with(o) )
+      length = parse_size( arg.substr(size(o)) );
+    else if ( constexpr std::string_view o = "--batch="; arg.starts_with(o) )
+      batch = arg.substr(size(o));
+    else if ( constexpr std::string_view o = "--daemon="; arg.starts_with(o) )
+      daemon = arg.substr(size(o));
+    else
+      args.push_back( arg );
+  }
+
+  using verification = engine_options::verification;
+  const auto verify_only = opts.verify == verification::only;
+  if ( not decrypt_maybe or (batch or daemon ? not std::empty(args) :
+         transcrypt ? not *decrypt_maybe or size(args) < 4 or size(args) % 2 :
+         fetch ? size(args) != 2 :
+         upload ? size(args) != 1 :
+         size(args) < 1 or size(args) > 3 or
+         (size(args) == 2 and not verify_only)) )
   {
     std::clog <<
-      "usage: [un]aesgcm-real hex_IV|hex_256bit_key\n"
+      "usage: [un]aesgcm-real [options] hex_IV|hex_256bit_key"
+        " [in_file out_file]\n"
+      "       unaesgcm-real [options] --verify-only hex_IV|hex_256bit_key"
+        " [in_file]\n"
+      "       unaesgcm-real [options] --offset=N [--length=N]"
+        " hex_IV|hex_256bit_key [in_file out_file]\n"
+      "       unaesgcm-real [options] --checkpoint=file"
+        " hex_IV|hex_256bit_key in_file out_file\n"
+      "       unaesgcm-real [options] --fetch=url [--connections=N]"
+        " hex_IV|hex_256bit_key out_file\n"
+      "       aesgcm-real [options] --upload=url in_file\n"
+      "       aesgcm-real [options] --index=file [--index-every=N[K|M|G]]"
+        " [--index-no-mac]\n"
+      "         hex_IV|hex_256bit_key [in_file out_file]\n"
+      "       unaesgcm-real [options] --index=file --verify-only"
+        " hex_IV|hex_256bit_key in_file\n"
+      "       unaesgcm-real [options] --index=file --offset=N [--length=N]"
+        " hex_IV|hex_256bit_key\n"
+      "         in_file out_file\n"
+      "       unaesgcm-real [options] --transcrypt hex_IV|hex_256bit_key"
+        " in_file\n"
+      "         out_file new_hex_IV|hex_256bit_key"
+        " [out_file new_hex_IV|hex_256bit_key]...\n"
+      "       [un]aesgcm-real [options] --batch=manifest_file\n"
+      "       [un]aesgcm-real [options] --daemon=socket_path\n"
+      "options: --buffer-size=N[K|M|G] --threads=N --verify-first"
+        " --pipelined --io-uring\n"
+      "         --cipher=auto|libcrypto|aesni|vaes-avx2|vaes-avx512\n"
+      "         --stats[=fd] --drop-cache --direct-io --keep-unauthentic\n"
+      "         --hash=[ciphertext:]sha256|sha512|blake2b512|...\n"
       "example: unaesgcm-real 8d82e8083d601e7f67de918418ef6c3cb703ebb91c7a943"
-        "b9285eb5049fc319da4127bd6df34fedec8c58b71\n";
+        "b9285eb5049fc319da4127bd6df34fedec8c58b71\n"
+      "manifest lines: in_file<TAB>out_file<TAB>hex_IV|hex_256bit_key\n";
+    return 2;
+  }
+  if ( opts.io_uring and opts.out_cache != engine_options::output_cache::keep )
+  {
+    std::clog << "--io-uring goes through the page cache, without"
+      " --drop-cache or --direct-io\n";
     return 2;
   }
-  const auto [iv, key] = parse_iv_and_key( argv[1] );
+  if ( not std::empty(opts.hashes) and (verify_only or batch or daemon or
+         offset or length or checkpoint or fetch or transcrypt) )
+  {
+    std::clog << "--hash applies to whole single de-/encryptions only\n";
+    return 2;
+  }
+  if ( index )
+  {
+    if ( batch or daemon or transcrypt or checkpoint or fetch or upload or
+         not std::empty(opts.hashes) or (*decrypt_maybe and (size(args) !=
+         (verify_only ? 2 : 3) or verify_only == (offset or length))) )
+    {
+      std::clog << "--index applies to single encryptions, --verify-only"
+        " and --offset/--length only\n";
+      return 2;
+    }
+    const auto [iv, key] = parse_iv_and_key( args[0] );
+    if ( not *decrypt_maybe )
+    {
+      // written along the way
+      aesgcm_indexed( iv, key,
+        size(args) > 1 ? std::string{args[1]}.c_str() : "/dev/stdin",
+        size(args) > 2 ? std::string{args[2]}.c_str() : "/dev/stdout",
+        index->c_str(), index_every, index_mac, opts );
+      return 0;
+    }
+    if ( verify_only )
+    {
+      // every segment at once, and which are wrong (logged)
+      const auto failed = unaesgcm_check_index( iv, key,
+        std::string{args[1]}.c_str(), index->c_str(), opts );
+      if ( std::empty(failed) )
+        return 0;
+      std::clog << "authentication failed (input may have been tampered"
+        " with)\n";
+      return 1;
+    }
+    if ( unaesgcm_range_indexed( iv, key, std::string{args[1]}.c_str(),
+           std::string{args[2]}.c_str(), index->c_str(), offset.value_or(0),
+           length.value_or(UINT64_MAX), opts ) )
+      return 0;
+    std::clog <<
+      "authentication failed (input may have been tampered with), "
+      "nothing written\n";
+    return 1;
+  }
+  if ( offset or length )
+  {
+    // a window of the plaintext, unauthenticated
+    if ( not *decrypt_maybe or size(args) == 2 or batch or daemon or
+         transcrypt or checkpoint or fetch or upload )
+    {
+      std::clog << "--offset/--length apply to single decryptions only\n";
+      return 2;
+    }
+    const auto [iv, key] = parse_iv_and_key( args[0] );
+    unaesgcm_range( iv, key,
+      size(args) > 1 ? std::string{args[1]}.c_str() : "/dev/stdin",
+      size(args) > 2 ? std::string{args[2]}.c_str() : "/dev/stdout",
+      offset.value_or(0), length.value_or(UINT64_MAX), opts );
+    return 0;
+  }
+  if ( fetch )
+  {
+    // several ranges at once, straight from the server
+    if ( not *decrypt_maybe or size(args) != 2 or batch or daemon or
+         transcrypt or checkpoint or upload or
+         opts.verify != verification::during )
+    {
+      std::clog << "--fetch applies to single decryptions into a file only\n";
+      return 2;
+    }
+    const auto [iv, key] = parse_iv_and_key( args[0] );
+    if ( unaesgcm_fetch( iv, key, fetch->c_str(),
+           std::string{args[1]}.c_str(), connections, opts ) )
+      return 0;
+    std::clog <<
+      "authentication failed (input may have been tampered with), "
+      "output discarded\n";
+    return 1;
+  }
+  if ( upload )
+  {
+    // under a new IV and key, which only the URL printed has
+    if ( *decrypt_maybe or batch or daemon or transcrypt or checkpoint or
+         fetch )
+    {
+      std::clog << "--upload applies to single encryptions only\n";
+      return 2;
+    }
+    std::cout << aesgcm_upload( std::string{args[0]}.c_str(),
+      upload->c_str(), opts ) << std::endl;
+    return 0;
+  }
+  if ( checkpoint )
+  {
+    // resumed from the checkpoint, if there is one, with the input being the
+    // rest of the ciphertext
+    if ( not *decrypt_maybe or size(args) != 3 or batch or daemon or
+         transcrypt or opts.verify != verification::during )
+    {
+      std::clog << "--checkpoint applies to single decryptions into a file"
+        " only\n";
+      return 2;
+    }
+    const auto [iv, key] = parse_iv_and_key( args[0] );
+    if ( unaesgcm_resumable( iv, key, std::string{args[1]}.c_str(),
+           std::string{args[2]}.c_str(), checkpoint->c_str(),
+           std::uint64_t{64} << 20, opts ) )
+      return 0;
+    std::clog <<
+      "authentication failed (input may have been tampered with, "
+      "output is untrustworthy)\n";
+    return 1;
+  }
+  if ( transcrypt )
+  {
+    // re-encrypted under every new IV and key, all or nothing
+    if ( not *decrypt_maybe or size(args) < 4 or size(args) % 2 or batch or
+         daemon or checkpoint or fetch or upload )
+    {
+      std::clog << "--transcrypt applies to single decryptions only, into"
+        " out_file new_IV|key pairs\n";
+      return 2;
+    }
+    const auto [iv, key] = parse_iv_and_key( args[0] );
+    std::vector<transcrypt_target> targets;
+    for ( auto i = 2u; i < size(args); i += 2 )
+    {
+      auto [new_iv, new_key] = parse_iv_and_key( args[i+1] );
+      targets.push_back( {std::move(new_iv), new_key, std::string{args[i]}} );
+    }
+    if ( unaesgcm_transcrypt( iv, key, std::string{args[1]}.c_str(),
+           targets, opts ) )
+      return 0;
+    std::clog <<
+      "authentication failed (input may have been tampered with), "
+      "nothing written\n";
+    return 1;
+  }
+  if ( daemon )
+  {
+    // serves until SIGINT or SIGTERM, taken synchronously by a side thread
+    sigset_t stop_signals;
+    sigemptyset( &stop_signals );
+    sigaddset( &stop_signals, SIGINT );
+    sigaddset( &stop_signals, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, &stop_signals, nullptr );
+    std::stop_source stop;
+    std::thread{ [stop, stop_signals]() mutable
+    {
+      int sig;
+      sigwait( &stop_signals, &sig );
+      stop.request_stop();
+    } }.detach();
+    aesgcm_daemon( daemon->c_str(), opts, stop.get_token() );
+    return 0;
+  }
+  if ( batch )
+  {
+    std::ifstream file;
+    if ( *batch != "-" )
+      file.open( *batch );
+    if ( *batch != "-" and not file )
+    {
+      std::clog << "failed to open "<< *batch <<'\n';
+      return 2;
+    }
+    return aesgcm_batch( *decrypt_maybe,
+      *batch != "-" ? file : std::cin, std::cout, opts ) ? 0 : 1;
+  }
+  const auto [iv, key] = parse_iv_and_key( args[0] );
   std::clog << "IV size: "<< size(iv) <<" bytes\n";
+  // verification needs a file to go over twice, and io_uring a descriptor,
+  // so stdin is taken by name
+  const auto on_files = size(args) > 1 or opts.io_uring or
+    (*decrypt_maybe and opts.verify != verification::during);
+  const auto in_path  = std::string{ size(args) > 1 ? args[1] : "/dev/stdin" };
+  const auto out_path = std::string{ size(args) > 2 ? args[2] :
+    verify_only ? "/dev/null" : "/dev/stdout" };
   if ( not *decrypt_maybe )
   {
-    aesgcm( iv, key, std::cin, std::cout );
+    if ( on_files )
+      aesgcm( iv, key, in_path.c_str(), out_path.c_str(), opts );
+    else
+      aesgcm( iv, key, std::cin, std::cout, opts );
     return 0;
   }
-  else if ( unaesgcm(iv, key, std::cin, std::cout) )
+  else if ( on_files ?
+    unaesgcm(iv, key, in_path.c_str(), out_path.c_str(), opts) :
+    unaesgcm(iv, key, std::cin, std::cout, opts) )
     return 0;
+  else if ( opts.verify != verification::during )
+  {
+    std::clog <<
+      "authentication failed (input may have been tampered with), "
+      "nothing written\n";
+    return 1;
+  }
+  else if ( on_files and not opts.keep_unauthentic )
+  {
+    std::clog <<
+      "authentication failed (input may have been tampered with), "
+      "output discarded (unless not a regular file)\n";
+    return 1;
+  }
   else
   {
     std::clog <<
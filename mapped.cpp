@@ -0,0 +1,332 @@
+#include "posixio.hpp"
+#include "gcmparts.hpp"
+#include "alignedbuf.hpp"
+#include <fstream>
+#include <algorithm>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+static bool is_regular( const char *const path )
+{
+  struct stat st;
+  return ::stat(path, &st) == 0 and S_ISREG(st.st_mode);
+}
+
+// The data from a bounce buffer of whole pages to a preallocated regular
+// file at explicit offsets, the tag with the last of it, and then, behind the
+// write cursor, out of the page cache: with O_DIRECT, it never gets there; else
+// the previous chunk is waited for (the current one under way meanwhile) and
+// dropped. The input read is dropped as well.
+static bool uncached( gcm_cipher &cipher,
+  const byte *const body, const std::size_t body_size, gcm_tag tag,
+  const int in, const int out, const char *const out_path, const bool direct,
+  const engine_options &opts )
+{
+  using std::data;
+
+  constexpr std::size_t page = 4096;
+  const auto decrypt = cipher.decrypting();
+  auto &stats = cipher.statistics();
+  stats.backend = direct ? "direct" : "uncached";
+  const auto chunk = std::max( checked_buffer_size(opts) / page * page, page );
+  stats.chunk_size = chunk;
+  const alignedbuf<byte,page> bounce( chunk + page );
+  const auto out_size = not decrypt ? body_size + tag_size : body_size;
+
+  std::size_t prev_off = 0, prev_len = 0;
+  for ( std::size_t off = 0;; )
+  {
+    const auto n = std::min( chunk, body_size-off );
+    const auto last = off+n == body_size;
+    cipher.update( body+off, data(bounce), n );
+    auto len = n;
+    if ( last and not decrypt )
+    {
+      tag = cipher.finalize_enc();
+      std::copy( std::begin(tag), std::end(tag), data(bounce)+n );
+      len += tag_size;
+    }
+    {
+      const auto timed = stats.time( stats.write_wait );
+      // O_DIRECT takes whole pages only: the end is padded and cut off after
+      const auto padded = direct ? (len + page-1) / page * page : len;
+      std::fill( data(bounce)+len, data(bounce)+padded, byte{} );
+      write_fully_at( out, data(bounce), padded, static_cast<off_t>(off) );
+      stats.bytes_written += len;
+      if ( not direct )
+      {
+        ::sync_file_range( out, static_cast<off_t>(off),
+          static_cast<off_t>(len), SYNC_FILE_RANGE_WRITE );
+        if ( prev_len )
+        {
+          ::sync_file_range( out, static_cast<off_t>(prev_off),
+            static_cast<off_t>(prev_len), SYNC_FILE_RANGE_WAIT_BEFORE|
+            SYNC_FILE_RANGE_WRITE|SYNC_FILE_RANGE_WAIT_AFTER );
+          ::posix_fadvise( out, static_cast<off_t>(prev_off),
+            static_cast<off_t>(prev_len), POSIX_FADV_DONTNEED );
+        }
+        prev_off = off;
+        prev_len = len;
+      }
+      ::madvise( const_cast<byte *>(body)+off, n, MADV_DONTNEED );
+      ::posix_fadvise( in, static_cast<off_t>(off), static_cast<off_t>(n),
+        POSIX_FADV_DONTNEED );
+    }
+    off += n;
+    if ( last )
+      break;
+  }
+  if ( direct and ::ftruncate(out, static_cast<off_t>(out_size)) )
+    sys_failed( "ftruncate", out_path );
+  if ( prev_len )
+  {
+    ::fdatasync( out );
+    ::posix_fadvise( out, static_cast<off_t>(prev_off),
+      static_cast<off_t>(prev_len), POSIX_FADV_DONTNEED );
+  }
+
+  if ( opts.verbose )
+    log_result( decrypt, body_size, tag );
+  return not decrypt or cipher.finalize_dec(tag);
+}
+
+static bool files( gcm_cipher &cipher,
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const engine_options &opts )
+{
+  using std::cerr;
+  using std::data;
+
+  const auto decrypt = cipher.decrypting();
+  auto &stats = cipher.statistics();
+  stats.timing = opts.stats_fd >= 0;
+
+  using verification = engine_options::verification;
+  const auto verify = decrypt ? opts.verify : verification::during;
+
+  // the output is opened by whichever path takes the job, io_uring only if
+  // it's there (and not to keep the output out of the cache)
+  if ( opts.io_uring and verify == verification::during and
+       opts.out_cache == engine_options::output_cache::keep )
+  {
+    const unique_fd in{ ::open(in_path, O_RDONLY|O_CLOEXEC) };
+    if ( not in )
+      sys_failed( "open", in_path );
+    if ( const auto authentic = aesgcm_uring( cipher,
+           in.get(), in_path, out_path, opts ) )
+      return *authentic;
+  }
+
+  if ( not is_regular(in_path) )
+  {
+    // unknown size, no random access: fall back to streaming
+    if ( verify == verification::first )
+    {
+      cerr << "error: verifying first needs a regular input file\n";
+      throw see_stderr{};
+    }
+    std::ifstream in {in_path,  std::ios_base::binary};
+    std::ofstream out{verify == verification::only ? "/dev/null" : out_path,
+      std::ios_base::binary};
+    if ( not in or not out )
+    {
+      cerr << "error: failed to open '"<< (not in ? in_path : out_path) <<"'\n";
+      throw io_error{};
+    }
+    return aesgcm_stream( cipher, in, out, opts );
+  }
+
+  const auto buffer_size = checked_buffer_size(opts);
+
+  const unique_fd in{ ::open(in_path, O_RDONLY|O_CLOEXEC) };
+  if ( not in )
+    sys_failed( "open", in_path );
+  struct stat st;
+  if ( ::fstat(in.get(), &st) )
+    sys_failed( "stat", in_path );
+  const auto in_size = static_cast<std::size_t>(st.st_size);
+
+  // the tag, if any, is fetched up front so the body is just a plain range
+  gcm_tag tag;
+  if ( decrypt )
+  {
+    if ( in_size < tag_size )
+    {
+      cerr << "error: input too short ("<< in_size <<" bytes)\n";
+      throw see_stderr{};
+    }
+    const auto off = static_cast<off_t>(in_size - tag_size);
+    if ( ::pread(in.get(), data(tag), tag_size, off) != ssize_t{tag_size} )
+      sys_failed( "pread", in_path );
+  }
+  const auto body_size = not decrypt ? in_size : in_size - tag_size;
+  const auto out_size  = not decrypt ? in_size + tag_size : body_size;
+
+  // the reading is done by page faults, and counted as crypto time
+  const mapping body{ in.get(), body_size, PROT_READ, in_path };
+  body.advise( MADV_SEQUENTIAL );
+  stats.backend = "mapped";
+  stats.chunk_size = buffer_size;
+  stats.bytes_read = in_size;
+
+  const auto parallel = [&]( byte *const out )
+  {
+    const auto timed = stats.time( stats.crypto );
+    ++stats.cipher_calls;
+    stats.bytes_processed += body_size;
+    return gcm_parallel( decrypt, iv, key, data(body), out, body_size, opts );
+  };
+
+  // GHASH alone, before the output is even opened
+  if ( verify != verification::during )
+  {
+    const auto computed = parallel( nullptr );
+    const auto authentic = gcm_parts::tags_equal( computed, tag );
+    if ( opts.verbose )
+      std::clog << "ciphertext size: "<< body_size <<" bytes\n"
+        << "tag: "<< hexed(tag) <<'\n'
+        << (authentic ? "authentic\n" : "not authentic\n");
+    if ( not authentic or verify == verification::only )
+      return authentic;
+  }
+
+  // a regular (or new) output file is preallocated and mapped, too, unless
+  // it's to stay out of the page cache; anything else (a pipe, a terminal) is
+  // written to from a bounce buffer
+  using output_cache = engine_options::output_cache;
+  const auto out_regular = is_regular(out_path) or
+    (::access(out_path, F_OK) != 0 and errno == ENOENT);
+  auto cache = out_regular ? opts.out_cache : output_cache::keep;
+  const auto open_out = [&]
+  {
+    return unique_fd{ ::open( out_path, not out_regular ?
+      O_WRONLY|O_CLOEXEC : O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC |
+      (cache == output_cache::direct ? O_DIRECT : 0), 0666 ) };
+  };
+  auto out = open_out();
+  if ( not out and cache == output_cache::direct and errno == EINVAL )
+  {
+    cache = output_cache::drop;
+    out = open_out();
+  }
+  if ( not out )
+    sys_failed( "open", out_path );
+  const auto out_mappable = out_regular and cache == output_cache::keep;
+  mapping out_map;
+  alignedbuf<byte> bounce;
+  if ( out_regular )
+  {
+    preallocate( out.get(), out_size, out_path );
+    if ( ::ftruncate(out.get(), static_cast<off_t>(out_size)) )
+      sys_failed( "ftruncate", out_path );
+  }
+  if ( out_mappable )
+  {
+    out_map = mapping{ out.get(), out_size, PROT_READ|PROT_WRITE, out_path };
+    out_map.advise( MADV_SEQUENTIAL );
+  }
+  else if ( not out_regular )
+    bounce = alignedbuf<byte>( std::min(buffer_size, body_size) );
+  else
+    return uncached( cipher, data(body), body_size, tag, in.get(), out.get(),
+      out_path, cache == output_cache::direct, opts );
+
+  if ( opts.threads != 1 and out_mappable )
+  {
+    stats.backend = "parallel";
+    const auto computed = parallel( data(out_map) );
+    if ( not decrypt )
+      std::copy( std::begin(computed), std::end(computed),
+        data(out_map)+body_size );
+    stats.bytes_written = out_size;
+    if ( opts.verbose )
+      log_result( decrypt, body_size, not decrypt ? computed : tag );
+    return not decrypt or gcm_parts::tags_equal( computed, tag );
+  }
+
+  for ( std::size_t off = 0; off != body_size; )
+  {
+    const auto n = std::min( buffer_size, body_size-off );
+    if ( out_mappable )
+      cipher.update( data(body)+off, data(out_map)+off, n );
+    else
+    {
+      cipher.update( data(body)+off, data(bounce), n );
+      const auto timed = stats.time( stats.write_wait );
+      write_fully( out.get(), data(bounce), n );
+    }
+    stats.bytes_written += n;
+    off += n;
+  }
+
+  if ( not decrypt )
+  {
+    tag = cipher.finalize_enc();
+    if ( opts.verbose )
+      log_result( decrypt, body_size, tag );
+    if ( out_mappable )
+      std::copy( std::begin(tag), std::end(tag), data(out_map)+body_size );
+    else
+      write_fully( out.get(), data(tag), tag_size );
+    stats.bytes_written += tag_size;
+    return true;
+  }
+  if ( opts.verbose )
+    log_result( decrypt, body_size, tag );
+  return cipher.finalize_dec(tag);
+}
+
+bool aesgcm_files( gcm_cipher &cipher,
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const engine_options &opts )
+{
+  const auto existed = ::access(out_path, F_OK) == 0;
+  const auto authentic = files( cipher, iv, key, in_path, out_path, opts );
+  using verification = engine_options::verification;
+  if ( authentic or opts.keep_unauthentic or
+       opts.verify == verification::only or not is_regular(out_path) )
+    return authentic;
+  // truncated (or removed) all at once, so nobody reads any of it
+  if ( existed ? ::truncate(out_path, 0) : ::unlink(out_path) )
+    sys_failed( existed ? "truncate" : "unlink", out_path );
+  return authentic;
+}
+
+// everything through the one cipher, which takes the digests, if any
+static engine_options hashable( engine_options opts )
+{
+  if ( not std::empty(opts.hashes) )
+    opts.threads = 1;
+  return opts;
+}
+
+void aesgcm(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const engine_options &opts )
+{
+  gcm_cipher cipher{encrypt, iv, key, opts.cipher};
+  cipher.hash( opts.hashes );
+  [[maybe_unused]] const auto ok =
+    aesgcm_files( cipher, iv, key, in_path, out_path, hashable(opts) );
+  if ( opts.verbose )
+    cipher.log_hashes();
+  emit_stats( cipher.statistics(), opts, encrypt, in_path );
+}
+
+bool unaesgcm(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const engine_options &opts )
+{
+  gcm_cipher cipher{decrypt, iv, key, opts.cipher};
+  cipher.hash( opts.hashes );
+  const auto authentic =
+    aesgcm_files( cipher, iv, key, in_path, out_path, hashable(opts) );
+  if ( opts.verbose )
+    cipher.log_hashes();
+  emit_stats( cipher.statistics(), opts, decrypt, in_path, authentic );
+  return authentic;
+}
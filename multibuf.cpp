@@ -0,0 +1,119 @@
+#include "gcmkernel.hpp"
+#include <deque>
+
+// one message after the other, through whatever gcm_cipher picks
+static void gcm_sequential( const bool decrypt,
+  const std::span<gcm_message> messages,
+  const engine_options::implementation impl )
+{
+  std::optional<gcm_cipher> cipher;
+  for ( auto &m : messages )
+  {
+    if ( cipher )
+      cipher->reset( decrypt, m.iv, m.key );
+    else
+      cipher.emplace( decrypt, m.iv, m.key, impl );
+    for ( std::size_t done = 0; done != m.size; )
+    {
+      const auto n = std::min( m.size-done, std::size_t{int_max_u} );
+      cipher->update( m.in+done, m.out+done, n );
+      done += n;
+    }
+    if ( not decrypt )
+      m.tag = cipher->finalize_enc();
+    else
+      m.authentic = cipher->finalize_dec( m.tag );
+  }
+}
+
+void gcm_multi( const bool decrypt, const std::span<gcm_message> messages,
+  const engine_options::implementation impl )
+{
+  using std::size;
+  using ::size;
+
+  const auto in_tree = gcm_kernel::choose( impl );
+  const auto lanes = in_tree ? gcm_kernel::lanes(*in_tree) : 1;
+  if ( lanes == 1 )
+    return gcm_sequential( decrypt, messages, impl );
+
+  for ( const auto &m : messages )
+    if ( std::empty(m.iv) or m.size > gcm_kernel::max_length )
+    {
+      std::cerr << "error: "<< (std::empty(m.iv) ?
+        "zero-length IV\n" : "message too long for GCM\n");
+      throw see_stderr{};
+    }
+
+  // a message in a lane, and how far it's got
+  struct lane
+  {
+    gcm_kernel kernel;
+    gcm_message *m = nullptr;
+    std::size_t done = 0;
+  };
+  std::vector<lane> active( lanes, lane{gcm_kernel{*in_tree}} );
+
+  const auto finish = [&]( lane &l )
+  {
+    auto &m = *l.m;
+    if ( not l.kernel.update( decrypt, m.in+l.done, m.out+l.done,
+           m.size-l.done ) )
+      throw std::logic_error{"message length checked above"};
+    if ( not decrypt )
+      m.tag = l.kernel.finish();
+    else
+      m.authentic = gcm_parts::tags_equal( l.kernel.finish(), m.tag );
+    l.m = nullptr;
+  };
+
+  // The lanes all need the same number of rounds, so each key size has its
+  // own go. A lane left with less than a block is finished on its own, and
+  // refilled; once there's nothing to refill it with, the stragglers are
+  // finished one by one.
+  for ( const auto key_size : {bits<128>, bits<192>, bits<256>} )
+  {
+    std::deque<gcm_message *> queue;
+    for ( auto &m : messages )
+      if ( size(m.key) == key_size )
+        queue.push_back( &m );
+
+    for ( ;; )
+    {
+      for ( auto &l : active )
+        while ( not l.m and not std::empty(queue) )
+        {
+          l.m = queue.front();
+          queue.pop_front();
+          l.done = 0;
+          l.kernel.set_key( l.m->key );
+          l.kernel.reset( l.m->iv );
+          if ( l.m->size < block_size )
+            finish( l );
+        }
+      if ( std::ranges::any_of( active, [](const lane &l){ return not l.m; } ) )
+        break;
+
+      auto blocks = std::numeric_limits<std::size_t>::max();
+      gcm_kernel *kernels[4];
+      const byte *in[4];
+      byte *out[4];
+      for ( auto i = 0u; i < lanes; ++i )
+      {
+        const auto &l = active[i];
+        blocks = std::min( blocks, (l.m->size - l.done) / block_size );
+        kernels[i] = &active[i].kernel;
+        in[i]  = l.m->in  + l.done;
+        out[i] = l.m->out + l.done;
+      }
+      gcm_kernel::update_lanes( decrypt,
+        std::span{kernels, lanes}, in, out, blocks );
+      for ( auto &l : active )
+        if ( (l.done += blocks*block_size) + block_size > l.m->size )
+          finish( l );
+    }
+    for ( auto &l : active )
+      if ( l.m )
+        finish( l );
+  }
+}
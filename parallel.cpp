@@ -0,0 +1,71 @@
+#include "gcmparts.hpp"
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <cassert>
+
+gcm_tag gcm_parallel( const bool decrypt,
+  const std::vector<byte> &iv, const aes_key &key,
+  const byte *const in, byte *const out, const std::size_t n,
+  const engine_options &opts )
+{
+  const auto buffer_size = checked_buffer_size(opts) / block_size * block_size;
+  assert( out or decrypt );
+  const gcm_parts parts{iv, key};
+
+  // segments are whole blocks (bar the last) and not too small to bother
+  constexpr auto min_segment_size = std::size_t{1} << 20;
+  const auto threads = std::max( 1u, opts.threads ? opts.threads :
+    std::thread::hardware_concurrency() );
+  const auto segment_size = std::max( min_segment_size,
+    blocks_in(n/threads + 1) * block_size );
+  const auto segments = std::max( std::size_t{1},
+    (n + segment_size-1) / segment_size );
+
+  std::vector<gf128> partials(segments);
+  std::vector<std::exception_ptr> failures(segments);
+  const auto work = [&]( const std::size_t k ) noexcept
+  {
+    try
+    {
+      ghash_partial ghash{parts};
+      gcm_ctr ctr{parts};
+      const auto end = std::min( n, (k+1)*segment_size );
+      for ( auto off = k*segment_size; off < end; )
+      {
+        const auto len = std::min( buffer_size, end-off );
+        if ( decrypt )
+          ghash.update( in+off, len );
+        if ( out )
+          ctr.crypt( off/block_size, in+off, out+off, len );
+        if ( not decrypt )
+          ghash.update( out+off, len );
+        off += len;
+      }
+      partials[k] = ghash.finish();
+    }
+    catch ( ... )
+    {
+      failures[k] = std::current_exception();
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    workers.reserve( segments-1 );
+    for ( auto k = std::size_t{1}; k < segments; ++k )
+      workers.emplace_back( work, k );
+    work( 0 );
+  }
+  for ( const auto &f : failures )
+    if ( f )
+      std::rethrow_exception( f );
+
+  // only the last segment may differ in length
+  gf128 acc;
+  const auto H_segment = parts.H.pow( segment_size/block_size );
+  const auto H_last = parts.H.pow( blocks_in(n - (segments-1)*segment_size) );
+  for ( auto k = std::size_t{0}; k < segments; ++k )
+    acc = acc*(k+1 < segments ? H_segment : H_last) ^ partials[k];
+  return parts.tag( acc, n );
+}
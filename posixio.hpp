@@ -0,0 +1,130 @@
+
+#ifndef UNAESGCM_POSIXIO_HPP
+#define UNAESGCM_POSIXIO_HPP
+
+#include "engine.hpp"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+[[noreturn]] inline void sys_failed(
+  const std::string_view what, const std::string_view path = {} )
+{
+  const auto err = errno;
+  std::cerr << "error: "<< what;
+  if ( not std::empty(path) )
+    std::cerr <<" '"<< path <<"'";
+  std::cerr <<" failed: "<< std::strerror(err) <<'\n';
+  throw io_error{};
+}
+
+class unique_fd
+{
+  int fd = -1;
+public:
+  unique_fd() = default;
+  explicit unique_fd( const int fd ) : fd{fd} {}
+  unique_fd( unique_fd &&o ) noexcept : fd{std::exchange(o.fd,-1)} {}
+  unique_fd &operator=( unique_fd o ) noexcept
+  { std::swap(fd, o.fd); return *this; }
+  ~unique_fd() { if ( fd >= 0 ) ::close(fd); }
+  int get() const { return fd; }
+  explicit operator bool() const { return fd >= 0; }
+};
+
+class mapping
+{
+  void       *addr = MAP_FAILED;
+  std::size_t len  = 0;
+public:
+  mapping() = default;
+  // a zero-length mapping is valid, yet maps nothing
+  mapping( const int fd, const std::size_t len, const int prot,
+    const std::string_view path, const off_t offset = 0 )
+    : len{len}
+  {
+    if ( len and (addr = ::mmap(nullptr, len, prot, MAP_SHARED, fd, offset))
+           == MAP_FAILED )
+      sys_failed( "mmap", path );
+  }
+  mapping( mapping &&o ) noexcept
+    : addr{std::exchange(o.addr,MAP_FAILED)}, len{std::exchange(o.len,0)} {}
+  mapping &operator=( mapping o ) noexcept
+  { std::swap(addr, o.addr); std::swap(len, o.len); return *this; }
+  ~mapping() { if ( addr != MAP_FAILED ) ::munmap(addr, len); }
+  auto data() const { return addr != MAP_FAILED ?
+    static_cast<byte *>(addr) : nullptr; }
+  auto size() const { return len; }
+  void advise( const int advice ) const
+  { if ( addr != MAP_FAILED ) ::madvise( addr, len, advice ); }
+};
+
+// retries on EINTR and short transfers; returns less than n only at eof
+inline std::size_t read_fully( const int fd, byte *buf, const std::size_t n )
+{
+  std::size_t done = 0;
+  while ( done != n )
+  {
+    const auto r = ::read( fd, buf+done, n-done );
+    if ( r == 0 )
+      break;
+    if ( r < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+      sys_failed( "read" );
+    }
+    done += static_cast<std::size_t>(r);
+  }
+  return done;
+}
+
+inline void write_fully( const int fd, const byte *buf, std::size_t n )
+{
+  while ( n )
+  {
+    const auto w = ::write( fd, buf, n );
+    if ( w < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+      sys_failed( "write" );
+    }
+    buf += w;
+    n   -= static_cast<std::size_t>(w);
+  }
+}
+
+inline void write_fully_at( const int fd, const byte *buf, std::size_t n,
+  off_t off )
+{
+  while ( n )
+  {
+    const auto w = ::pwrite( fd, buf, n, off );
+    if ( w < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+      sys_failed( "write" );
+    }
+    buf += w;
+    n   -= static_cast<std::size_t>(w);
+    off += w;
+  }
+}
+
+// reserves a regular file's blocks up to size at once, so that it's laid out
+// in one piece rather than grown write by write, and sized; where the
+// filesystem can't, it's left to grow
+inline void preallocate( const int fd, const std::uint64_t size,
+  const std::string_view path )
+{
+  if ( size and ::fallocate(fd, 0, 0, static_cast<off_t>(size)) and
+       errno != EOPNOTSUPP and errno != ENOSYS )
+    sys_failed( "fallocate", path );
+}
+
+#endif
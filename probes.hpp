@@ -0,0 +1,24 @@
+#ifndef UNAESGCM_PROBES_HPP
+#define UNAESGCM_PROBES_HPP
+
+// USDT probes of provider "unaesgcm", for bpftrace, SystemTap, perf and the
+// like (see probes/): each a single nop in the code, with its arguments noted
+// down for the tracer to find. There are none at all if <sys/sdt.h> (from
+// SystemTap's SDT headers) is missing, or UNAESGCM_NO_PROBES is defined.
+//
+//   read_start   (want)                  read_done    (got, total_read)
+//   update_start (n)                     update_done  (n, total_processed)
+//   write_start  (n)                     write_done   (n)
+//   finalize_enc (total_processed)       finalize_dec (total_processed,
+//                                                      authentic)
+
+#if __has_include(<sys/sdt.h>) and not defined(UNAESGCM_NO_PROBES)
+#include <sys/sdt.h>
+#define UNAESGCM_PROBE1( name, a )    STAP_PROBE1( unaesgcm, name, a )
+#define UNAESGCM_PROBE2( name, a, b ) STAP_PROBE2( unaesgcm, name, a, b )
+#else
+#define UNAESGCM_PROBE1( name, a )    static_cast<void>(0)
+#define UNAESGCM_PROBE2( name, a, b ) static_cast<void>(0)
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+#include "posixio.hpp"
+#include "gcmparts.hpp"
+#include "alignedbuf.hpp"
+#include <algorithm>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+void unaesgcm_range(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const std::uint64_t offset, std::uint64_t length,
+  const engine_options &opts )
+{
+  using std::data;
+
+  const gcm_parts parts{iv, key};
+  gcm_ctr ctr{parts};
+
+  const unique_fd in{ ::open(in_path, O_RDONLY|O_CLOEXEC) };
+  if ( not in )
+    sys_failed( "open", in_path );
+  const unique_fd out{ ::open(out_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,
+    0666) };
+  if ( not out )
+    sys_failed( "open", out_path );
+  struct stat st;
+  if ( ::fstat(in.get(), &st) )
+    sys_failed( "stat", in_path );
+
+  // The window is widened to whole blocks at its start. A regular file is
+  // read from there directly, and its tag is excluded; anything else is
+  // skipped through and taken to be all ciphertext, tag or not.
+  const auto seekable = S_ISREG(st.st_mode);
+  if ( seekable )
+  {
+    const auto body_size = std::max<std::uint64_t>(
+      static_cast<std::uint64_t>(st.st_size), tag_size ) - tag_size;
+    length = std::min( length, body_size - std::min(offset, body_size) );
+  }
+  const auto head = offset % block_size;
+  auto pos = offset - head;
+
+  const auto buffer_size =
+    std::max( checked_buffer_size(opts) / block_size, std::size_t{1} ) *
+    block_size;
+  const alignedbuf<byte> buf( buffer_size );
+  engine_stats stats{ .backend = "range", .chunk_size = buffer_size,
+    .timing = opts.stats_fd >= 0 };
+
+  auto at_eof = false;
+  if ( not seekable )
+    for ( auto skip = pos; skip and not at_eof; )
+    {
+      const auto n = static_cast<std::size_t>(
+        std::min<std::uint64_t>(skip, buffer_size) );
+      const auto timed = stats.time( stats.read_wait );
+      const auto got = read_fully( in.get(), data(buf), n );
+      stats.bytes_read += got;
+      at_eof = got != n;
+      skip -= n;
+    }
+
+  std::uint64_t written = 0;
+  for ( auto skip = head; written != length and not at_eof; skip = 0 )
+  {
+    const auto want = skip + static_cast<std::size_t>(
+      std::min<std::uint64_t>( length-written, buffer_size-skip ) );
+    std::size_t got;
+    if ( const auto timed = stats.time(stats.read_wait); seekable )
+    {
+      const auto r = ::pread( in.get(), data(buf), want,
+        static_cast<off_t>(pos) );
+      if ( r < 0 )
+        sys_failed( "pread", in_path );
+      got = static_cast<std::size_t>(r);
+    }
+    else
+      got = read_fully( in.get(), data(buf), want );
+    stats.bytes_read += got;
+    at_eof = got != want;
+    if ( got <= skip )
+      break;
+
+    {
+      const auto timed = stats.time( stats.crypto );
+      ctr.crypt( pos/block_size, data(buf), data(buf), got );
+      ++stats.cipher_calls;
+      stats.bytes_processed += got;
+    }
+    {
+      const auto timed = stats.time( stats.write_wait );
+      write_fully( out.get(), data(buf)+skip, got-skip );
+      stats.bytes_written += got-skip;
+    }
+    pos     += got;
+    written += got-skip;
+  }
+
+  if ( opts.verbose )
+    std::clog << "warning: bytes "<< offset <<" to "<< offset+written
+      <<" of the plaintext decrypted WITHOUT authentication\n";
+  emit_stats( stats, opts, decrypt, in_path );
+}
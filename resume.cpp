@@ -0,0 +1,188 @@
+#include "sidecar.hpp"
+#include "alignedbuf.hpp"
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+// How far a decryption got: the ciphertext bytes decrypted (and written) so
+// far, always whole blocks, and the GHASH chain over them. Kept as text:
+//
+//   unaesgcm-checkpoint 1
+//   processed 1073741824
+//   ghash <32 hex digits>
+//   mac <64 hex digits>
+//
+// where the MAC is HMAC-SHA256, under the AES key, of the IV and the rest.
+// The GHASH alone would give away H to anyone with the ciphertext, and a
+// forged one would pass off anything as authentic.
+struct checkpoint
+{
+  std::uint64_t processed = 0;
+  gf128 acc;
+
+  static constexpr std::string_view magic = "unaesgcm-checkpoint 1";
+
+  sidecar_mac::value_type mac( const std::vector<byte> &iv,
+    const aes_key &key ) const
+  {
+    return (sidecar_mac{magic, iv} << processed << acc.store()).of( key );
+  }
+
+  // nothing if there's no checkpoint at path; throws if there's one but not
+  // of this IV and key
+  static std::optional<checkpoint> load( const char *const path,
+    const std::vector<byte> &iv, const aes_key &key )
+  {
+    if ( ::access(path, F_OK) != 0 and errno == ENOENT )
+      return {};
+    std::ifstream in{path};
+    if ( not in )
+      sys_failed( "open", path );
+    std::string line, word, ghash_hex, mac_hex;
+    checkpoint c;
+    std::getline( in, line );
+    const auto ok = line == magic and
+      in >> word and word == "processed" and in >> c.processed and
+      in >> word and word == "ghash" and in >> ghash_hex and
+      in >> word and word == "mac" and in >> mac_hex and
+      std::size(ghash_hex) == 2*block_size and
+      c.processed % block_size == 0;
+    try
+    {
+      if ( ok )
+      {
+        c.acc = gf128::load( std::data( parse_hex( std::data(ghash_hex),
+          block{}, "GHASH" ) ) );
+        if ( sidecar_mac::matches( mac_hex, c.mac(iv, key) ) )
+          return c;
+      }
+    }
+    catch ( const std::runtime_error & )
+    {
+    }
+    std::cerr << "error: '"<< path <<"' is no checkpoint of this IV and key\n";
+    throw see_stderr{};
+  }
+
+  void save( const char *const path,
+    const std::vector<byte> &iv, const aes_key &key ) const
+  {
+    std::ostringstream text;
+    text << magic <<'\n'
+      << "processed "<< processed <<'\n'
+      << "ghash "<< to_hex(acc.store()) <<'\n'
+      << "mac "<< to_hex(mac(iv, key)) <<'\n';
+    sidecar_save( path, text.str() );
+  }
+};
+
+bool unaesgcm_resumable(
+  const std::vector<byte> &iv, const aes_key &key,
+  const char *const in_path, const char *const out_path,
+  const char *const checkpoint_path, const std::uint64_t checkpoint_every,
+  const engine_options &opts )
+{
+  using std::data;
+
+  const gcm_parts parts{iv, key};
+  auto state = checkpoint::load( checkpoint_path, iv, key );
+  const auto resumed = state.has_value();
+  if ( not state )
+    state.emplace();
+
+  const unique_fd in{ ::open(in_path, O_RDONLY|O_CLOEXEC) };
+  if ( not in )
+    sys_failed( "open", in_path );
+  const unique_fd out{ ::open(out_path, O_WRONLY|O_CREAT|O_CLOEXEC, 0666) };
+  if ( not out )
+    sys_failed( "open", out_path );
+  struct stat st;
+  if ( ::fstat(out.get(), &st) )
+    sys_failed( "stat", out_path );
+  if ( not S_ISREG(st.st_mode) or
+       static_cast<std::uint64_t>(st.st_size) < state->processed )
+  {
+    std::cerr << "error: '"<< out_path <<"' is "<< (not S_ISREG(st.st_mode) ?
+      "not a regular file\n" : "shorter than the checkpoint says\n");
+    throw see_stderr{};
+  }
+  const auto resume_at = static_cast<off_t>(state->processed);
+  if ( ::ftruncate(out.get(), resume_at) or
+       ::lseek(out.get(), resume_at, SEEK_SET) != resume_at )
+    sys_failed( "truncate", out_path );
+  if ( resumed and opts.verbose )
+    std::clog << "resuming after "<< state->processed <<" bytes\n";
+
+  // whole blocks at a time, behind a lookbehind of one tag size
+  const auto chunk = checked_buffer_size(opts) / block_size * block_size;
+  const alignedbuf<byte> ring( tag_size + chunk );
+  std::size_t held = 0;
+  ghash_partial ghash{parts};
+  gcm_ctr ctr{parts};
+  const auto H_chunk = parts.H.pow( chunk/block_size );
+
+  engine_stats stats{ .backend = "resumable", .chunk_size = chunk,
+    .timing = opts.stats_fd >= 0 };
+  std::uint64_t since_saved = 0;
+  gcm_tag tag;
+  for (;;)
+  {
+    const auto got = [&]
+    {
+      const auto timed = stats.time( stats.read_wait );
+      return read_fully( in.get(), data(ring)+held, chunk );
+    }();
+    stats.bytes_read += got;
+    const auto avail = held + got;
+    if ( avail < tag_size )
+    {
+      std::cerr << "error: input too short ("<< stats.bytes_read <<" bytes)\n";
+      throw see_stderr{};
+    }
+    const auto body = avail - tag_size;
+    {
+      const auto timed = stats.time( stats.crypto );
+      ghash.update( data(ring), body );
+      ctr.crypt( state->processed/block_size, data(ring), data(ring), body );
+      state->acc = state->acc * (body == chunk ?
+        H_chunk : parts.H.pow(blocks_in(body))) ^ ghash.finish();
+      stats.cipher_calls += 2;
+      stats.bytes_processed += body;
+    }
+    {
+      const auto timed = stats.time( stats.write_wait );
+      write_fully( out.get(), data(ring), body );
+      stats.bytes_written += body;
+    }
+    state->processed += body;
+    if ( got != chunk )  // eof
+    {
+      std::copy_n( data(ring)+body, tag_size, data(tag) );
+      break;
+    }
+    std::copy_n( data(ring)+body, tag_size, data(ring) );
+    held = tag_size;
+
+    // the output first, so it's never short of what the checkpoint says
+    if ( (since_saved += body) >= checkpoint_every )
+    {
+      const auto timed = stats.time( stats.write_wait );
+      if ( ::fdatasync(out.get()) )
+        sys_failed( "fdatasync", out_path );
+      state->save( checkpoint_path, iv, key );
+      since_saved = 0;
+    }
+  }
+
+  if ( opts.verbose )
+    log_result( decrypt, state->processed, tag );
+  const auto authentic = gcm_parts::tags_equal(
+    parts.tag(state->acc, state->processed), tag );
+  // an input cut short looks just like a forged one: the checkpoint stays,
+  // for the rest of it
+  if ( authentic and ::unlink(checkpoint_path) and errno != ENOENT )
+    sys_failed( "unlink", checkpoint_path );
+  emit_stats( stats, opts, decrypt, in_path, authentic );
+  return authentic;
+}
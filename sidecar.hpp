@@ -0,0 +1,82 @@
+#ifndef UNAESGCM_SIDECAR_HPP
+#define UNAESGCM_SIDECAR_HPP
+
+// Small text files kept beside a ciphertext (checkpoints, indices), MACed
+// under the AES key and replaced all at once
+
+#include "posixio.hpp"
+#include "gcmparts.hpp"
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
+#include <fcntl.h>
+
+// HMAC-SHA256, under the AES key, of a file's magic line, the IV and the
+// file's fields, in order
+class sidecar_mac
+{
+  std::vector<byte> msg;
+
+public:
+  using value_type = std::array<byte,32>;
+
+  sidecar_mac( const std::string_view magic, const std::vector<byte> &iv )
+    : msg{ std::begin(magic), std::end(magic) }
+  {
+    msg.insert( std::end(msg), std::begin(iv), std::end(iv) );
+  }
+
+  // big-endian
+  sidecar_mac &operator<<( const std::uint64_t n )
+  {
+    for ( auto i = 0u; i < 8; ++i )
+      msg.push_back( static_cast<byte>(n >> (56-8*i)) );
+    return *this;
+  }
+
+  sidecar_mac &operator<<( const block &b )
+  {
+    msg.insert( std::end(msg), std::begin(b), std::end(b) );
+    return *this;
+  }
+
+  value_type of( const aes_key &key ) const
+  {
+    value_type m;
+    unsigned len;
+    checked(HMAC,( EVP_sha256(), ::data(key), static_cast<int>(::size(key)),
+      std::data(msg), std::size(msg), std::data(m), &len ));
+    return m;
+  }
+
+  // whether hex is the expected MAC, compared in constant time; throws on
+  // bad digits
+  static bool matches( const std::string &hex, const value_type &expected )
+  {
+    if ( std::size(hex) != 2*std::tuple_size_v<value_type> )
+      return false;
+    const auto m = parse_hex( std::data(hex), value_type{}, "MAC" );
+    return CRYPTO_memcmp( std::data(m), std::data(expected),
+      std::size(m) ) == 0;
+  }
+};
+
+// replaces whatever is at path with text, for its owner only, never leaving
+// half of it there
+inline void sidecar_save( const char *const path, const std::string_view text )
+{
+  const auto tmp_path = std::string{path} + ".tmp";
+  {
+    const unique_fd fd{ ::open( tmp_path.c_str(),
+      O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600 ) };
+    if ( not fd )
+      sys_failed( "open", tmp_path );
+    write_fully( fd.get(), reinterpret_cast<const byte *>(std::data(text)),
+      std::size(text) );
+    if ( ::fsync(fd.get()) )
+      sys_failed( "fsync", tmp_path );
+  }
+  if ( ::rename(tmp_path.c_str(), path) )
+    sys_failed( "rename", tmp_path );
+}
+
+#endif
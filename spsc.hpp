@@ -0,0 +1,81 @@
+#ifndef UNAESGCM_SPSC_HPP
+#define UNAESGCM_SPSC_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+// A bounded queue from one producer thread to one consumer thread, without
+// locks: the ends only ever touch their own index and read the other's.
+// Either end blocks (on a futex, via atomic wait) while it can't proceed,
+// until the other end makes room or the queue is closed by anyone.
+template<typename T, std::size_t Capacity>
+class spsc_queue
+{
+  static_assert( Capacity and (Capacity & (Capacity-1)) == 0 );
+
+  std::array<T,Capacity> slots;
+  alignas(64) std::atomic<std::size_t> head{0};  // next to pop
+  alignas(64) std::atomic<std::size_t> tail{0};  // next to push
+  // bumped on every change, for the other end to wait on
+  alignas(64) std::atomic<std::uint32_t> seq{0};
+  std::atomic<bool> closed{false};
+
+  void changed()
+  {
+    seq.fetch_add( 1, std::memory_order_release );
+    seq.notify_all();
+  }
+
+  // waits until ready() unless closed, and returns whether it is
+  template<typename Ready>
+  bool await( const Ready ready )
+  {
+    for ( ;; )
+    {
+      const auto s = seq.load( std::memory_order_acquire );
+      if ( closed.load(std::memory_order_acquire) )
+        return false;
+      if ( ready() )
+        return true;
+      seq.wait( s, std::memory_order_acquire );
+    }
+  }
+
+public:
+  // false if the queue was closed
+  bool push( T v )
+  {
+    const auto t = tail.load( std::memory_order_relaxed );
+    if ( not await([&]{
+           return t - head.load(std::memory_order_acquire) != Capacity; }) )
+      return false;
+    slots[t % Capacity] = std::move(v);
+    tail.store( t+1, std::memory_order_release );
+    changed();
+    return true;
+  }
+
+  // nothing if the queue was closed
+  std::optional<T> pop()
+  {
+    const auto h = head.load( std::memory_order_relaxed );
+    if ( not await([&]{
+           return tail.load(std::memory_order_acquire) != h; }) )
+      return {};
+    auto v = std::move( slots[h % Capacity] );
+    head.store( h+1, std::memory_order_release );
+    changed();
+    return v;
+  }
+
+  // makes both ends give up, now and from now on
+  void close()
+  {
+    closed.store( true, std::memory_order_release );
+    changed();
+  }
+};
+
+#endif
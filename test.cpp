@@ -2,8 +2,20 @@
 #include "aesgcm.hpp"
 #include "hex.hpp"
 #include "fixcapvec.hpp"
+#include "gcmparts.hpp"
+#include "gcmkernel.hpp"
+#include "libunaesgcm.hpp"
+#include "daemonproto.hpp"
+#include <openssl/evp.h>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <set>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 #include <cassert>
+#include <cstdlib>
 
 template<
   template<typename, std::size_t> class Cont,
@@ -34,11 +46,12 @@ template<char... Digits> inline auto operator""_str()
 
 template<typename K, typename P>
 std::string aesgcm(
-  const K &key, const std::vector<byte> &iv, const P &pt )
+  const K &key, const std::vector<byte> &iv, const P &pt,
+  const engine_options &opts = {} )
 {
   std::istringstream in{pt};
   std::ostringstream out;
-  aesgcm(iv, key, in, out);
+  aesgcm(iv, key, in, out, opts);
   return out.str();
 }
 
@@ -56,6 +69,39 @@ std::optional<std::string> unaesgcm(
     return {};
 }
 
+template<typename K>
+std::optional<std::string> unaesgcm(
+  const K &key, const std::vector<byte> &iv, const std::string &ct_and_tag,
+  const engine_options &opts = {} )
+{
+  std::istringstream in{ct_and_tag};
+  std::ostringstream out;
+  if ( bool authentic = unaesgcm(iv, key, in, out, opts) )
+    return out.str();
+  else
+    return {};
+}
+
+// whole files, for the engines that take paths
+std::string slurp( const std::string &path )
+{
+  std::ifstream f{path, std::ios_base::binary};
+  return std::string{std::istreambuf_iterator<char>{f}, {}};
+}
+
+void spit( const std::string &path, const std::string &s )
+{
+  std::ofstream{path, std::ios_base::binary} << s;
+}
+
+// a path of this run's own, in $TMPDIR
+std::string temp_path( const std::string_view name )
+{
+  const auto tmpdir = std::getenv( "TMPDIR" );
+  return std::string{tmpdir and *tmpdir ? tmpdir : "/tmp"} +
+    "/unaesgcm-test-"+ std::string{name} +"-"+ std::to_string( getpid() );
+}
+
 int main()
 {
   // The test vectors are from
@@ -142,4 +188,735 @@ int main()
     const auto Tag = 0xb75f616fd1a3d6563b62b899e5a7e522_arr;
     assert(( not unaesgcm(Key,IV,CT,Tag) ));
     }
+
+  // chunking must not affect the result
+  {
+    const auto Key = 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf4218a2fa90f632ec8a_arr;
+    const auto IV  = 0x1f3afa4711e9474f32e70462_vec;
+    std::string PT(100'003, '\0');
+    for ( auto i = 0u; i < size(PT); ++i )
+      PT[i] = static_cast<char>( i*i ^ i>>8 );
+    const auto CT_Tag = aesgcm(Key,IV,PT);
+    for ( const std::size_t buffer_size : {16, 17, 4096, 65536, 1<<20} )
+    {
+      const auto opts = engine_options{ .buffer_size = buffer_size };
+      assert(( aesgcm(Key,IV,PT,opts) == CT_Tag ));
+      assert(( unaesgcm(Key,IV,CT_Tag,opts) == PT ));
+      for ( const auto len : {0u, 15u, 16u, 17u, 32u, 4111u} )
+        assert(( unaesgcm(Key,IV,aesgcm(Key,IV,PT.substr(0,len),opts),opts) ==
+          PT.substr(0,len) ));
+    }
+    auto Tampered = CT_Tag;
+    Tampered[size(Tampered)-17] ^= 1;
+    assert(( not unaesgcm(Key,IV,Tampered,{.buffer_size = 4096}) ));
+  }
+
+  // the in-tree kernels agree with libcrypto, at any width, key size and IV
+  // size, and across pieces of any size
+  for ( const auto impl : {cipher_impl::aesni, cipher_impl::vaes_avx2,
+         cipher_impl::vaes_avx512} )
+  {
+    if ( not gcm_kernel::supported(impl) )
+      continue;
+    {
+      const auto Key = 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf4218a2fa90f632ec8a_arr;
+      const auto IV  = 0x1f3afa4711e9474f32e70462_vec;
+      const auto PT  = 0x06b2c75853df9aeb17befd33cea81c630b0fc53667ff45199c629c8e15dce41e530aa792f796b8138eeab2e86c7b7bee1d40b0_str;
+      const auto CT  = 0x91fbd061ddc5a7fcc9513fcdfdc9c3a7c5d4d64cedf6a9c24ab8a77c36eefbf1c5dc00bc50121b96456c8cd8b6ff1f8b3e480f_str;
+      const auto Tag = 0x30096d340f3d5c42d82a6f475def23eb_str;
+      assert(( aesgcm(Key,IV,PT,{.cipher = impl}) == CT+Tag ));
+    }
+    std::string PT(70'001, '\0');
+    for ( auto i = 0u; i < size(PT); ++i )
+      PT[i] = static_cast<char>( i*7 ^ i>>5 );
+    const auto u = []( std::string &s )
+    { return reinterpret_cast<byte *>( data(s) ); };
+    const auto check = [&]( const aes_key &key, const std::vector<byte> &IV )
+    {
+      for ( const auto len : {0u, 1u, 15u, 16u, 17u, 127u, 128u, 129u, 511u,
+             512u, 513u, 4103u, 70'001u} )
+      {
+        auto ref = PT.substr(0, len), ct = ref;
+        gcm_cipher lib{false, IV, key, cipher_impl::libcrypto};
+        lib.update( u(ref), u(ref), len );
+        const auto ref_tag = lib.finalize_enc();
+
+        // in pieces of odd sizes, in place
+        gcm_cipher enc{false, IV, key, impl}, dec{true, IV, key, impl};
+        for ( std::size_t off = 0, i = 0; off < len; ++i )
+        {
+          const auto n = std::min<std::size_t>( len-off,
+            std::array{1u, 5u, 16u, 33u, 300u, 1000u, 9000u}[i % 7] );
+          enc.update( u(ct)+off, u(ct)+off, n );
+          off += n;
+        }
+        assert(( ct == ref and enc.finalize_enc() == ref_tag ));
+        auto pt = ct;
+        dec.update( u(pt), u(pt), 0 );
+        dec.update( u(pt), u(pt), len );
+        assert(( pt == PT.substr(0, len) and dec.finalize_dec(ref_tag) ));
+      }
+    };
+    check( 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf4218a2fa90f632ec8a_arr, 0x1f3afa4711e9474f32e70462_vec );
+    check( 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf42_arr, 0x1f3afa4711e9474f_vec );
+    check( 0x1fded32d5999de4a76e0f8082108823a_arr, 0x1f3afa4711e9474f32e704621f3afa4711e9474f32e704621f3afa4711e9474f32e70462_vec );
+
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    const auto CT_Tag = aesgcm(Key,IV,PT,{.cipher = cipher_impl::libcrypto});
+    assert(( aesgcm(Key,IV,PT,{.cipher = impl}) == CT_Tag ));
+    assert(( unaesgcm(Key,IV,CT_Tag,{.cipher = impl}) == PT ));
+    auto Tampered = CT_Tag;
+    Tampered[size(Tampered)-17] ^= 1;
+    assert(( not unaesgcm(Key,IV,Tampered,{.cipher = impl}) ));
+  }
+
+  // many messages at once agree with one at a time, whatever their mix of
+  // key sizes and lengths
+  for ( const auto impl : {cipher_impl::automatic, cipher_impl::libcrypto,
+         cipher_impl::aesni, cipher_impl::vaes_avx2, cipher_impl::vaes_avx512} )
+  {
+    if ( impl != cipher_impl::automatic and impl != cipher_impl::libcrypto and
+         not gcm_kernel::supported(impl) )
+      continue;
+    const aes_key keys[] = {
+      0x1fded32d5999de4a76e0f8082108823aef60417e1896cf4218a2fa90f632ec8a_arr,
+      0x1fded32d5999de4a76e0f8082108823aef60417e1896cf42_arr,
+      0x1fded32d5999de4a76e0f8082108823a_arr };
+    std::vector<std::string> pts(41);
+    for ( auto i = 0u; i < size(pts); ++i )
+    {
+      pts[i].resize( i*i*37 % 5000 );
+      for ( auto k = 0u; k < size(pts[i]); ++k )
+        pts[i][k] = static_cast<char>( k*i ^ k>>3 );
+    }
+    auto cts = pts;
+    std::vector<gcm_message> messages;
+    for ( auto i = 0u; i < size(pts); ++i )
+    {
+      const auto ct = reinterpret_cast<byte *>( data(cts[i]) );
+      messages.push_back( { std::vector<byte>(1 + i%16, static_cast<byte>(i)),
+        keys[i*7 % 3], ct, ct, size(cts[i]), {} } );
+    }
+    gcm_multi( false, messages, impl );
+    for ( auto i = 0u; i < size(pts); ++i )
+    {
+      std::istringstream pt{pts[i]};
+      std::ostringstream ref;
+      aesgcm( messages[i].iv, messages[i].key, pt, ref,
+        {.verbose = false, .cipher = cipher_impl::libcrypto} );
+      const auto &tag = messages[i].tag;
+      assert(( ref.str() == cts[i] + std::string(begin(tag), end(tag)) ));
+    }
+    messages[5].tag[0] ^= 1;
+    gcm_multi( true, messages, impl );
+    for ( auto i = 0u; i < size(pts); ++i )
+      assert(( cts[i] == pts[i] and messages[i].authentic == (i != 5) ));
+  }
+
+  // pipelined agrees with serial
+  {
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    for ( const auto len : {0u, 15u, 16u, 17u, 4096u, 100'003u} )
+    {
+      std::string PT(len, '\0');
+      for ( auto i = 0u; i < len; ++i )
+        PT[i] = static_cast<char>( i*11 );
+      const auto CT_Tag = aesgcm(Key,IV,PT);
+      for ( const auto buffer_size : {16u, 17u, 4096u, 65536u} )
+      {
+        const engine_options opts{ .buffer_size = buffer_size, .pipelined = true };
+        assert(( aesgcm(Key,IV,PT,opts) == CT_Tag ));
+        assert(( unaesgcm(Key,IV,CT_Tag,opts) == PT ));
+        auto Tampered = CT_Tag;
+        Tampered.back() ^= 1;
+        assert(( not unaesgcm(Key,IV,Tampered,opts) ));
+      }
+    }
+    bool threw = false;
+    try { static_cast<void>( unaesgcm(Key,IV,std::string(15,'x'),{.pipelined = true}) ); }
+    catch ( const std::exception & ) { threw = true; }
+    assert(( threw ));
+  }
+
+  // statistics, a line of JSON per operation
+  {
+    const auto Key = 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf4218a2fa90f632ec8a_arr;
+    const auto IV  = 0x1f3afa4711e9474f32e70462_vec;
+    const std::string PT(100'000, 'x');
+    int fds[2];
+    assert(( ::pipe(fds) == 0 ));
+    const auto CT_Tag = aesgcm(Key,IV,PT,
+      {.buffer_size = 4096, .verbose = false, .stats_fd = fds[1]});
+    assert(( unaesgcm(Key,IV,CT_Tag,
+      {.verbose = false, .pipelined = true, .stats_fd = fds[1]}) == PT ));
+    ::close( fds[1] );
+    std::string json(8192, '\0');
+    json.resize( static_cast<std::size_t>(
+      ::read(fds[0], data(json), size(json)) ) );
+    ::close( fds[0] );
+    const auto nl = json.find('\n');
+    const auto enc = json.substr(0, nl), dec = json.substr(nl+1);
+    for ( const auto field : {"\"op\": \"encrypt\"", "\"backend\": \"stream\"",
+           "\"chunk_size\": 4096", "\"bytes_read\": 100000",
+           "\"bytes_processed\": 100000", "\"bytes_written\": 100016",
+           "\"cipher_calls\": 26", "\"read_wait\": {\"wall_seconds\": "} )
+      assert(( enc.find(field) != enc.npos ));
+    for ( const auto field : {"\"op\": \"decrypt\"",
+           "\"backend\": \"pipelined\"", "\"bytes_read\": 100016",
+           "\"bytes_written\": 100000", "\"authentic\": true}\n"} )
+      assert(( dec.find(field) != dec.npos ));
+    assert(( enc.find("authentic") == enc.npos ));
+  }
+
+  // digests of the plaintext and of the ciphertext with its tag, taken on the
+  // way, in the cipher's thread or off it
+  {
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    std::string PT(100'003, '\0');
+    for ( auto i = 0u; i < size(PT); ++i )
+      PT[i] = static_cast<char>( i*13 );
+    const auto CT_Tag = aesgcm(Key,IV,PT);
+    const auto sha256 = []( const std::string &s )
+    {
+      std::array<byte,32> md;
+      EVP_Digest( data(s), size(s), data(md), nullptr, EVP_sha256(), nullptr );
+      return to_hex( md );
+    };
+    const auto digests = "plaintext sha256: "+ sha256(PT) +"\n"
+      "ciphertext sha256: "+ sha256(CT_Tag) +"\n";
+    for ( const auto pipelined : {false, true} )
+    {
+      const engine_options opts{ .buffer_size = 4096, .pipelined = pipelined,
+        .hashes = {"sha256", "ciphertext:sha256"} };
+      std::ostringstream log;
+      const auto clog = std::clog.rdbuf( log.rdbuf() );
+      assert(( aesgcm(Key,IV,PT,opts) == CT_Tag ));
+      assert(( unaesgcm(Key,IV,CT_Tag,opts) == PT ));
+      std::clog.rdbuf( clog );
+      const auto first = log.str().find( digests );
+      assert(( first != std::string::npos ));
+      assert(( log.str().find(digests, first+1) != std::string::npos ));
+    }
+    bool threw = false;
+    try { static_cast<void>( aesgcm(Key,IV,PT,{.hashes = {"md17"}}) ); }
+    catch ( const std::exception & ) { threw = true; }
+    assert(( threw ));
+  }
+
+  // io_uring (where available) agrees with streams, on files and pipes
+  {
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    const auto in_file = temp_path( "in" ), out_file = temp_path( "out" );
+    const auto in_path = in_file.c_str(), out_path = out_file.c_str();
+    for ( const auto len : {0u, 1u, 16u, 100'003u} )
+    {
+      std::string PT(len, '\0');
+      for ( auto i = 0u; i < len; ++i )
+        PT[i] = static_cast<char>( i*5 );
+      const auto CT_Tag = aesgcm(Key,IV,PT);
+      for ( const auto buffer_size : {16u, 4096u} )
+      {
+        const engine_options opts{ .buffer_size = buffer_size, .verbose = false,
+          .io_uring = true };
+        std::ofstream{in_path, std::ios_base::binary} << PT;
+        aesgcm( IV, Key, in_path, out_path, opts );
+        assert(( slurp(out_path) == CT_Tag ));
+
+        // the ciphertext from a pipe
+        int fds[2];
+        assert(( pipe(fds) == 0 ));
+        std::jthread writer{ [&, w = fds[1]]
+        {
+          std::size_t off = 0;
+          for ( ssize_t n; off < size(CT_Tag) and
+                  (n = write(w, data(CT_Tag)+off, size(CT_Tag)-off)) > 0; )
+            off += static_cast<std::size_t>(n);
+          close( w );
+        } };
+        const auto pipe_path = "/dev/fd/"+ std::to_string( fds[0] );
+        assert(( unaesgcm(IV, Key, pipe_path.c_str(), out_path, opts) ));
+        writer.join();
+        close( fds[0] );
+        assert(( slurp(out_path) == PT ));
+      }
+    }
+
+    // stdout taken as it is, here appending to a file: not truncated
+    {
+      const std::string PT(100'003, 'x');
+      std::ofstream{in_path, std::ios_base::binary} << PT;
+      std::ofstream{out_path, std::ios_base::binary} << "head";
+      std::fflush( stdout );
+      const auto saved = ::dup( STDOUT_FILENO );
+      const auto appending = ::open( out_path, O_WRONLY|O_APPEND );
+      assert(( saved >= 0 and appending >= 0 ));
+      ::dup2( appending, STDOUT_FILENO );
+      ::close( appending );
+      aesgcm( IV, Key, in_path, "/dev/stdout",
+        {.verbose = false, .io_uring = true} );
+      ::dup2( saved, STDOUT_FILENO );
+      ::close( saved );
+      const auto appended = slurp(out_path);
+      assert(( appended == "head"+ aesgcm(Key,IV,PT) or
+               appended == aesgcm(Key,IV,PT) ));  // no io_uring: mapped
+    }
+    std::remove( in_path );
+    std::remove( out_path );
+  }
+
+  // named files (mapped) agree with streams
+  {
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    const auto pt_file = temp_path( "pt" ), ct_file = temp_path( "ct" );
+    const auto pt_path = pt_file.c_str(), ct_path = ct_file.c_str();
+    for ( const auto len : {0u, 1u, 16u, 100'003u} )
+    {
+      std::string PT(len, '\0');
+      for ( auto i = 0u; i < len; ++i )
+        PT[i] = static_cast<char>( i*7 );
+      spit( pt_path, PT );
+      aesgcm( IV, Key, pt_path, ct_path, {.buffer_size = 4096} );
+      assert(( slurp(ct_path) == aesgcm(Key,IV,PT) ));
+      std::remove( pt_path );
+      assert(( unaesgcm(IV, Key, ct_path, pt_path) ));
+      assert(( slurp(pt_path) == PT ));
+      using verification = engine_options::verification;
+      assert(( unaesgcm(IV, Key, ct_path, pt_path, {.verify = verification::only}) ));
+      std::remove( pt_path );
+      assert(( unaesgcm(IV, Key, ct_path, pt_path, {.verify = verification::first}) ));
+      assert(( slurp(pt_path) == PT ));
+      using output_cache = engine_options::output_cache;
+      for ( const auto cache : {output_cache::drop, output_cache::direct} )
+      {
+        const engine_options uncached{.buffer_size = 4096, .out_cache = cache};
+        aesgcm( IV, Key, pt_path, ct_path, uncached );
+        assert(( slurp(ct_path) == aesgcm(Key,IV,PT) ));
+        assert(( unaesgcm(IV, Key, ct_path, pt_path, uncached) ));
+        assert(( slurp(pt_path) == PT ));
+      }
+      auto Tampered = slurp(ct_path);
+      Tampered.back() ^= 1;
+      spit( ct_path, Tampered );
+      assert(( not unaesgcm(IV, Key, ct_path, "/dev/null") ));
+      // the output of a wrong tag is truncated, or removed if it's new
+      assert(( not unaesgcm(IV, Key, ct_path, pt_path) ));
+      assert(( access(pt_path, F_OK) == 0 and std::empty(slurp(pt_path)) ));
+      std::remove( pt_path );
+      assert(( not unaesgcm(IV, Key, ct_path, pt_path) ));
+      assert(( access(pt_path, F_OK) != 0 ));
+      assert(( not unaesgcm(IV, Key, ct_path, pt_path,
+        {.keep_unauthentic = true}) ));
+      assert(( size(slurp(pt_path)) == len ));
+      std::remove( pt_path );
+      for ( const auto verify : {verification::first, verification::only} )
+      {
+        assert(( not unaesgcm(IV, Key, ct_path, pt_path, {.verify = verify}) ));
+        assert(( access(pt_path, F_OK) != 0 ));
+      }
+    }
+    std::remove( pt_path );
+    std::remove( ct_path );
+  }
+
+  // transcrypting agrees with decrypting and encrypting again, and writes
+  // nothing unless the input is authentic
+  {
+    const auto Key  = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV   = 0x0e396446655582838f27f72f_vec;
+    const auto Key2 = 0x31bdadd96698c204aa9ce1448ea94ae1fb4a9a0b3c9d773b51bb1822666b8f22_arr;
+    const auto IV2  = 0x0d18e06c7c725ac9e362e1ce_vec;
+    const auto Key3 = 0x460fc864972261c2560e1eb88761ff1c_arr;
+    const auto IV3  = 0x01_vec;
+    const auto dir = temp_path( "transcrypt" );
+    const auto in_path = dir + ".ct";
+    const std::vector<transcrypt_target> targets{
+      {IV2, Key2, dir + ".2"}, {IV3, Key3, dir + ".3"}};
+    for ( const auto len : {0u, 15u, 4096u, 100'003u} )
+    {
+      std::string PT(len, '\0');
+      for ( auto i = 0u; i < len; ++i )
+        PT[i] = static_cast<char>( i*13 );
+      auto CT = aesgcm(Key,IV,PT);
+      std::ofstream{in_path, std::ios_base::binary} << CT;
+      assert(( unaesgcm_transcrypt( IV, Key, in_path.c_str(), targets,
+        {.buffer_size = 4096, .verbose = false} ) ));
+      assert(( slurp(dir + ".2") == aesgcm(Key2,IV2,PT) ));
+      assert(( slurp(dir + ".3") == aesgcm(Key3,IV3,PT) ));
+      std::remove( (dir + ".2").c_str() );
+      std::remove( (dir + ".3").c_str() );
+
+      CT[CT.size()/2] ^= 1;
+      std::ofstream{in_path, std::ios_base::binary} << CT;
+      assert(( not unaesgcm_transcrypt( IV, Key, in_path.c_str(), targets,
+        {.buffer_size = 4096, .verbose = false} ) ));
+      assert(( access((dir + ".2").c_str(), F_OK) != 0 ));
+      assert(( access((dir + ".3").c_str(), F_OK) != 0 ));
+    }
+    // in place, as for rotating a key
+    const std::string PT(10'000, 'r');
+    std::ofstream{in_path, std::ios_base::binary} << aesgcm(Key,IV,PT);
+    assert(( unaesgcm_transcrypt( IV, Key, in_path.c_str(),
+      {{IV2, Key2, in_path}}, {.verbose = false} ) ));
+    assert(( slurp(in_path) == aesgcm(Key2,IV2,PT) ));
+    std::remove( in_path.c_str() );
+  }
+
+  // resuming from a checkpoint with the rest of the input agrees with
+  // decrypting in one go
+  {
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    const auto dir = temp_path( "resume" );
+    const auto ct_path = dir + ".ct", pt_path = dir + ".pt",
+      cp_path = dir + ".checkpoint";
+    const engine_options opts{.buffer_size = 4096, .verbose = false};
+    std::string PT(100'003, '\0');
+    for ( auto i = 0u; i < size(PT); ++i )
+      PT[i] = static_cast<char>( i*5 );
+    const auto CT = aesgcm(Key,IV,PT);
+
+    spit( ct_path, CT );
+    assert(( unaesgcm_resumable( IV, Key, ct_path.c_str(), pt_path.c_str(),
+      cp_path.c_str(), 4096, opts ) ));
+    assert(( slurp(pt_path) == PT ));
+    assert(( access(cp_path.c_str(), F_OK) != 0 ));
+
+    // cut short, then the rest from where the checkpoint says
+    spit( ct_path, CT.substr(0, 50'000) );
+    assert(( not unaesgcm_resumable( IV, Key, ct_path.c_str(),
+      pt_path.c_str(), cp_path.c_str(), 4096, opts ) ));
+    std::istringstream checkpoint{slurp(cp_path)};
+    std::string line, word;
+    std::uint64_t processed = 0;
+    std::getline( checkpoint, line );
+    checkpoint >> word >> processed;
+    assert(( word == "processed" and processed and processed < 50'000 ));
+    spit( ct_path, CT.substr(processed) );
+    assert(( unaesgcm_resumable( IV, Key, ct_path.c_str(), pt_path.c_str(),
+      cp_path.c_str(), 4096, opts ) ));
+    assert(( slurp(pt_path) == PT ));
+
+    // a forged checkpoint is refused
+    spit( ct_path, CT.substr(0, 50'000) );
+    assert(( not unaesgcm_resumable( IV, Key, ct_path.c_str(),
+      pt_path.c_str(), cp_path.c_str(), 4096, opts ) ));
+    auto Forged = slurp(cp_path);
+    Forged[Forged.find("ghash ")+6] ^= 1;
+    spit( cp_path, Forged );
+    auto refused = false;
+    try
+    {
+      [[maybe_unused]] const auto ok = unaesgcm_resumable( IV, Key,
+        ct_path.c_str(), pt_path.c_str(), cp_path.c_str(), 4096, opts );
+    }
+    catch ( const std::exception & )
+    {
+      refused = true;
+    }
+    assert(( refused ));
+    for ( const auto &p : {ct_path, pt_path, cp_path} )
+      std::remove( p.c_str() );
+  }
+
+  // an index written while encrypting vouches for segments, all at once or a
+  // window's worth
+  {
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    const auto dir = temp_path( "index" );
+    const auto pt_path = dir + ".pt", ct_path = dir + ".ct",
+      win_path = dir + ".win", ix_path = dir + ".index";
+    const engine_options opts{.buffer_size = 4096, .verbose = false};
+    for ( const auto len : {0u, 4096u, 8192u, 100'003u} )
+    {
+      std::string PT(len, '\0');
+      for ( auto i = 0u; i < len; ++i )
+        PT[i] = static_cast<char>( i*7 );
+      spit( pt_path, PT );
+      aesgcm_indexed( IV, Key, pt_path.c_str(), ct_path.c_str(),
+        ix_path.c_str(), 8192, true, opts );
+      const auto CT = slurp(ct_path);
+      assert(( CT == aesgcm(Key,IV,PT) ));
+      assert(( std::empty( unaesgcm_check_index( IV, Key, ct_path.c_str(),
+        ix_path.c_str(), {.threads = 3, .verbose = false} ) ) ));
+      assert(( unaesgcm_range_indexed( IV, Key, ct_path.c_str(),
+        win_path.c_str(), ix_path.c_str(), 5000, 10'000, opts ) ));
+      assert(( slurp(win_path) == PT.substr(std::min(len, 5000u), 10'000) ));
+    }
+
+    // a byte off in segment 5 of 13: caught there, and only there
+    auto Tampered = slurp(ct_path);
+    Tampered[5*8192 + 100] ^= 1;
+    spit( ct_path, Tampered );
+    assert(( unaesgcm_check_index( IV, Key, ct_path.c_str(), ix_path.c_str(),
+      {.threads = 3, .verbose = false} ) == std::vector<std::uint64_t>{5} ));
+    assert(( unaesgcm_range_indexed( IV, Key, ct_path.c_str(),
+      win_path.c_str(), ix_path.c_str(), 0, 5*8192, opts ) ));
+    std::remove( win_path.c_str() );
+    assert(( not unaesgcm_range_indexed( IV, Key, ct_path.c_str(),
+      win_path.c_str(), ix_path.c_str(), 5*8192 - 1, 2, opts ) ));
+    assert(( access(win_path.c_str(), F_OK) != 0 ));
+
+    // a forged index is refused, and one without a MAC vouches for nothing
+    // but the whole
+    auto Forged = slurp(ix_path);
+    Forged[Forged.find("ghash ")+12] ^= 1;
+    spit( ix_path, Forged );
+    const auto refused = [&]( auto &&f )
+    {
+      try { f(); } catch ( const std::exception & ) { return true; }
+      return false;
+    };
+    assert(( refused( [&]{ static_cast<void>( unaesgcm_check_index( IV, Key,
+      ct_path.c_str(), ix_path.c_str(), opts ) ); } ) ));
+    aesgcm_indexed( IV, Key, pt_path.c_str(), ct_path.c_str(),
+      ix_path.c_str(), 8192, false, opts );
+    assert(( std::empty( unaesgcm_check_index( IV, Key, ct_path.c_str(),
+      ix_path.c_str(), opts ) ) ));
+    assert(( refused( [&]{ static_cast<void>( unaesgcm_range_indexed( IV,
+      Key, ct_path.c_str(), win_path.c_str(), ix_path.c_str(), 0, 1,
+      opts ) ); } ) ));
+    for ( const auto &p : {pt_path, ct_path, win_path, ix_path} )
+      std::remove( p.c_str() );
+  }
+
+  // out-of-order building blocks
+  {
+    const auto Key = 0x31bdadd96698c204aa9ce1448ea94ae1fb4a9a0b3c9d773b51bb1822666b8f22_arr;
+    const auto IV  = 0x0d18e06c7c725ac9e362e1ce_vec;
+    const aes_key key{Key};
+    gcm_parts parts{IV, key};
+    assert(( parts.H * gf128::one() == parts.H ));
+    assert(( parts.H.pow(5) == parts.H*parts.H*parts.H*parts.H*parts.H ));
+
+    // the counter wraps around in its low 32 bits only
+    parts.J0[12] = parts.J0[13] = parts.J0[14] = 0xff;
+    parts.J0[15] = 0xfd;
+    std::array<byte,5*block_size> zeros{}, whole, blockwise;
+    gcm_ctr ctr{parts};
+    ctr.crypt( 0, std::data(zeros), std::data(whole), std::size(zeros) );
+    for ( auto i = 0u; i < 5; ++i )
+      ctr.crypt( i, std::data(zeros), std::data(blockwise)+i*block_size,
+        block_size );
+    assert(( whole == blockwise ));
+    assert(( parts.counter(2)[15] == 0 and parts.counter(2)[11] == parts.J0[11] ));
+  }
+
+  // multithreaded agrees with single-threaded, for any IV size and key size
+  {
+    std::string PT(3'500'017, '\0');
+    for ( auto i = 0u; i < size(PT); ++i )
+      PT[i] = static_cast<char>( i*i >> 3 );
+    const auto check = [&]( const auto &Key, const std::vector<byte> &IV )
+    {
+      const aes_key key{Key};
+      const auto CT_Tag = aesgcm(Key,IV,PT);
+      for ( const auto len : {size(PT), std::size_t{1}<<20, std::size_t{100}} )
+      {
+        const auto pt = reinterpret_cast<const byte *>( data(PT) );
+        std::string ct(len, '\0'), pt2(len, '\0');
+        const auto u = []( std::string &s )
+        { return reinterpret_cast<byte *>( data(s) ); };
+        for ( const auto threads : {2u, 4u} )
+        {
+          const auto opts = engine_options{ .buffer_size = 65536, .threads = threads };
+          const auto tag = gcm_parallel( false, IV, key, pt, u(ct), len, opts );
+          const auto ref = len == size(PT) ? CT_Tag : aesgcm(Key,IV,PT.substr(0,len));
+          assert(( ct+std::string{begin(tag), end(tag)} == ref ));
+          assert(( gcm_parallel( true, IV, key, u(ct), u(pt2), len, opts ) == tag ));
+          assert(( pt2 == PT.substr(0,len) ));
+        }
+      }
+    };
+    check( 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf4218a2fa90f632ec8a_arr, 0x1f3afa4711e9474f32e70462_vec );
+    check( 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf42_arr, 0x1f3afa4711e9474f_vec );
+    check( 0x1fded32d5999de4a76e0f8082108823a_arr, 0x1f3afa4711e9474f32e704621f3afa4711e9474f32e704621f3afa4711e9474f32e70462_vec );
+  }
+
+  // batches
+  {
+    const auto dir = temp_path( "batch" );
+    const auto ivkey = "0e396446655582838f27f72f"
+      "4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb";
+    const auto path = [&]( const auto i, const char *const ext )
+    { return dir + std::to_string(i) + ext; };
+    std::ostringstream enc_manifest, dec_manifest;
+    for ( auto i = 0u; i < 20; ++i )
+    {
+      std::ofstream{path(i,".pt")} << std::string(i*1000, static_cast<char>(i));
+      enc_manifest << path(i,".pt") <<'\t'<< path(i,".ct") <<'\t'<< ivkey <<'\n';
+      dec_manifest << path(i,".ct") <<'\t'<< path(i,".pt2") <<'\t'<< ivkey <<'\n';
+    }
+    dec_manifest << "# comment\n\n"
+      << path(99,".ct") <<'\t'<< path(99,".pt2") <<'\t'<< ivkey <<'\n'
+      << path(0,".ct") <<'\t'<< path(0,".pt2") <<"\tbad\n";
+
+    std::istringstream enc_in{enc_manifest.str()};
+    std::ostringstream enc_report;
+    assert(( aesgcm_batch( false, enc_in, enc_report, {.threads = 3} ) ));
+    std::ofstream{path(7,".ct"), std::ios_base::app} << 'x';
+    std::ofstream{path(7,".pt2")} << "stale";
+
+    std::istringstream dec_in{dec_manifest.str()};
+    std::ostringstream dec_report;
+    assert(( not aesgcm_batch( true, dec_in, dec_report, {.threads = 3} ) ));
+    std::multiset<std::string> lines;
+    std::istringstream report{dec_report.str()};
+    for ( std::string line; std::getline(report, line); )
+      lines.insert( line );
+    assert(( size(lines) == 22 ));
+    assert(( lines.count("auth-fail\t"+ path(7,".ct")) == 1 ));
+    assert(( lines.count("io-error\t"+ path(99,".ct")) == 1 ));
+    assert(( lines.count("error\t"+ path(0,".ct")) == 1 ));
+    for ( auto i = 0u; i < 20; ++i )
+    {
+      if ( i != 7 )
+      {
+        assert(( lines.count("ok\t"+ path(i,".ct")) == 1 ));
+        std::ifstream pt2{path(i,".pt2")};
+        assert(( std::string{std::istreambuf_iterator<char>{pt2}, {}} ==
+          std::string(i*1000, static_cast<char>(i)) ));
+      }
+      else
+      {
+        // tampered with: nothing of it, nor of what was there before
+        std::ifstream pt2{path(i,".pt2")};
+        assert(( pt2 and pt2.peek() == std::ifstream::traits_type::eof() ));
+      }
+      for ( const auto ext : {".pt", ".ct", ".pt2"} )
+        std::remove( path(i,ext).c_str() );
+    }
+  }
+
+  // the C ABI, through its C++ wrapper
+  {
+    using namespace libunaesgcm;
+    const auto Key = 0x4433db5fe066960bdd4e1d4d418b641c14bfcef9d574e29dcd0995352850f1eb_arr;
+    const auto IV  = 0x0e396446655582838f27f72f_vec;
+    const auto CT  = 0xb0d254abe43bdb563ead669192c1e57e9a85c51dba0f1c8501d1ce92273f1ce7e140dcfac94757fabb128caad16912cead0607_arr;
+    const auto Tag = 0xffd0b02c92dbfcfbe9d58f7ff9e6f506_arr;
+    const auto PT  = 0xd602c06b947abe06cf6aa2c5c1562e29062ad6220da9bc9c25d66a60bd85a80d4fbcc1fb4919b6566be35af9819aba836b8b47_arr;
+
+    context ctx;
+    assert(( ctx.valid() ));
+    std::array<byte,size(PT)> out;
+    std::size_t out_len;
+    tag t;
+    assert(( ctx.update(CT, out, out_len) == status::bad_state ));
+    assert(( ctx.init(true, std::span{Key}.first(20), IV) == status::bad_argument ));
+
+    // decryption, split unevenly
+    assert(( ctx.init(true, Key, IV) == status::ok ));
+    assert(( ctx.update(std::span{CT}.first(5), out, out_len) == status::ok and out_len == 5 ));
+    assert(( ctx.update(std::span{CT}.subspan(5), std::span{out}.first(10), out_len) == status::buffer_too_small ));
+    assert(( ctx.update(std::span{CT}.subspan(5), std::span{out}.subspan(5), out_len) == status::ok ));
+    t = Tag;
+    assert(( ctx.finalize(t) == status::ok and out == PT ));
+    assert(( ctx.finalize(t) == status::bad_state ));
+
+    // encryption, in place, with the same context
+    out = PT;
+    assert(( ctx.init(false, Key, IV) == status::ok ));
+    assert(( ctx.update(out, out, out_len) == status::ok and out == CT ));
+    assert(( ctx.finalize(t) == status::ok and t == Tag ));
+
+    t[0] ^= 1;
+    assert(( ctx.init(true, Key, IV) == status::ok ));
+    assert(( ctx.update(CT, out, out_len) == status::ok ));
+    assert(( ctx.finalize(t) == status::auth_failed ));
+    assert(( std::string_view{to_string(status::auth_failed)} == "authentication failed" ));
+  }
+
+  // byte ranges, through the files API and the C ABI
+  {
+    std::string PT(70'001, '\0');
+    for ( auto i = 0u; i < size(PT); ++i )
+      PT[i] = static_cast<char>( i*13 + (i>>8) );
+    const auto ct_file = temp_path( "ct" ), pt_file = temp_path( "pt" );
+    const auto ct_path = ct_file.c_str(), pt_path = pt_file.c_str();
+    const auto check = [&]( const auto &Key, const std::vector<byte> &IV )
+    {
+      const aes_key key{Key};
+      const auto CT_Tag = aesgcm(Key,IV,PT);
+      std::ofstream{ct_path, std::ios_base::binary} << CT_Tag;
+      libunaesgcm::context ctx;
+      for ( const auto offset : {0u, 1u, 16u, 31u, 4097u, 69'990u, 70'001u} )
+        for ( const auto length : {0u, 1u, 15u, 5000u, ~0u} )
+        {
+          unaesgcm_range( IV, key, ct_path, pt_path, offset, length,
+            {.buffer_size = 4096, .verbose = false} );
+          std::ifstream f{pt_path, std::ios_base::binary};
+          const auto expected = PT.substr( offset, length );
+          assert(( std::string{std::istreambuf_iterator<char>{f}, {}} == expected ));
+
+          const auto ct = reinterpret_cast<const byte *>( data(CT_Tag) ) + offset;
+          std::string out( size(expected), '\0' );
+          std::size_t out_len;
+          assert(( ctx.init_range(Key, IV, offset) == libunaesgcm::status::ok ));
+          const auto split = size(expected) / 3;
+          const auto o = reinterpret_cast<byte *>( data(out) );
+          assert(( ctx.update({ct, split}, {o, split}, out_len) == libunaesgcm::status::ok ));
+          assert(( ctx.update({ct+split, size(out)-split}, {o+split, size(out)-split}, out_len) == libunaesgcm::status::ok ));
+          libunaesgcm::tag t{};
+          assert(( ctx.finalize(t) == libunaesgcm::status::unauthenticated ));
+          assert(( out == expected ));
+        }
+    };
+    check( 0x1fded32d5999de4a76e0f8082108823aef60417e1896cf4218a2fa90f632ec8a_arr, 0x1f3afa4711e9474f32e70462_vec );
+    check( 0x1fded32d5999de4a76e0f8082108823a_arr, 0x1f3afa4711e9474f32e704621f3afa4711e9474f32e704621f3afa4711e9474f32e70462_vec );
+    std::remove( ct_path );
+    std::remove( pt_path );
+  }
+
+  // the daemon, with contexts reused across requests under the same key
+  {
+    const auto dir = temp_path( "daemon" );
+    const auto sock = dir +".sock";
+    std::jthread daemon{ [&]( const std::stop_token stop )
+    {
+      aesgcm_daemon( sock.c_str(), {.threads = 2}, stop );
+    } };
+    const auto request = [&]( const std::string &line,
+      const std::vector<int> &fds = {} )
+    {
+      int s;
+      for ( auto tries = 0; (s = daemonproto::connect(sock)) < 0 and tries < 100; ++tries )
+        std::this_thread::sleep_for( std::chrono::milliseconds{10} );
+      assert(( s >= 0 ));
+      assert(( daemonproto::send_request(s, line, fds) ));
+      const auto reply = daemonproto::receive_reply( s );
+      close( s );
+      return reply.value_or( "hung up" );
+    };
+    const auto key = std::string(64, 'a');
+    const std::string PT = "attack at dawn, or maybe a bit later";
+    std::ofstream{dir +".pt", std::ios_base::binary} << PT;
+    for ( const auto iv : {"000000000000000000000001", "02", "000000000000000000000001"} )
+    {
+      assert(( request("encrypt\t"+ std::string{iv} + key +"\t"+ dir +".pt\t"+ dir +".ct\n") == "ok" ));
+      const auto [IV, Key] = parse_iv_and_key( iv + key );
+      assert(( slurp(dir +".ct") == aesgcm(Key, IV, PT) ));
+      const auto in  = ::open( (dir +".ct").c_str(), O_RDONLY );
+      const auto out = ::open( (dir +".pt2").c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600 );
+      assert(( request("decrypt\t"+ std::string{iv} + key +"\t\t\n", {in, out}) == "ok" ));
+      close( in );
+      close( out );
+      assert(( slurp(dir +".pt2") == PT ));
+    }
+    std::ofstream{dir +".ct", std::ios_base::app} << 'x';
+    assert(( request("decrypt\t02"+ key +"\t"+ dir +".ct\t"+ dir +".pt2\n") == "auth-fail" ));
+    assert(( request("decrypt\t02"+ key +"\t"+ dir +".none\t"+ dir +".pt2\n") == "io-error" ));
+    assert(( request("decrypt\t02"+ key +"\t\t\n") == "error" ));
+    assert(( request("frobnicate\n") == "error" ));
+    daemon.request_stop();
+    daemon.join();
+    assert(( access(sock.c_str(), F_OK) != 0 ));
+    for ( const auto ext : {".pt", ".ct", ".pt2"} )
+      std::remove( (dir + ext).c_str() );
+  }
 }
@@ -0,0 +1,164 @@
+#include "posixio.hpp"
+#include "alignedbuf.hpp"
+#include <algorithm>
+#include <deque>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+// A temporary file in the directory of its destination, removed unless
+// committed. A destination that exists must be a regular file, and keeps its
+// permissions.
+class pending_output
+{
+  std::string path, tmp_path;
+  unique_fd fd;
+  mode_t mode;
+  bool committed = false;
+
+public:
+  explicit pending_output( std::string p )
+    : path{std::move(p)}, tmp_path{path + ".XXXXXX"}
+  {
+    struct stat st;
+    if ( ::stat(path.c_str(), &st) == 0 )
+    {
+      if ( not S_ISREG(st.st_mode) )
+      {
+        std::cerr << "error: '"<< path <<"' is not a regular file\n";
+        throw see_stderr{};
+      }
+      mode = st.st_mode & 07777;
+    }
+    else if ( errno != ENOENT )
+      sys_failed( "stat", path );
+    else
+    {
+      mode = ::umask( 0 );
+      ::umask( mode );
+      mode = 0666 & ~mode;
+    }
+    fd = unique_fd{ ::mkostemp(std::data(tmp_path), O_CLOEXEC) };
+    if ( not fd )
+      sys_failed( "mkstemp", tmp_path );
+  }
+  pending_output( const pending_output & ) = delete;
+  ~pending_output() { if ( not committed ) ::unlink( tmp_path.c_str() ); }
+
+  int get() const { return fd.get(); }
+  void sync() const
+  {
+    if ( ::fchmod(fd.get(), mode) )
+      sys_failed( "chmod", tmp_path );
+    if ( ::fsync(fd.get()) )
+      sys_failed( "fsync", tmp_path );
+  }
+  void commit()
+  {
+    if ( ::rename(tmp_path.c_str(), path.c_str()) )
+      sys_failed( "rename", tmp_path );
+    committed = true;
+  }
+};
+
+bool unaesgcm_transcrypt(
+  const std::vector<byte> &iv, const aes_key &key, const char *const in_path,
+  const std::vector<transcrypt_target> &targets, const engine_options &opts )
+{
+  using std::data;
+
+  const auto buffer_size = checked_buffer_size(opts);
+  const unique_fd in{ ::open(in_path, O_RDONLY|O_CLOEXEC) };
+  if ( not in )
+    sys_failed( "open", in_path );
+
+  gcm_cipher source{decrypt, iv, key, opts.cipher};
+  auto &stats = source.statistics();
+  stats.timing = opts.stats_fd >= 0;
+  stats.backend = "transcrypt";
+  stats.chunk_size = buffer_size;
+
+  // deques, for neither is movable
+  std::deque<gcm_cipher> ciphers;
+  std::deque<pending_output> outputs;
+  for ( const auto &t : targets )
+  {
+    ciphers.emplace_back( encrypt, t.iv, t.key, opts.cipher );
+    ciphers.back().statistics().timing = stats.timing;
+    outputs.emplace_back( t.out_path );
+  }
+
+  // The input is decrypted in place, one chunk at a time, behind a lookbehind
+  // of one tag size as in aesgcm_stream; every target then encrypts the chunk
+  // into the scratch buffer in turn, and writes it out from there.
+  const alignedbuf<byte> ring( tag_size + buffer_size ), scratch( buffer_size );
+  std::size_t held = 0;
+
+  const auto fan_out = [&]( const byte *const pt, const std::size_t n )
+  {
+    for ( std::size_t i = 0; i != size(targets); ++i )
+    {
+      ciphers[i].update( pt, data(scratch), n );
+      const auto timed = stats.time( stats.write_wait );
+      write_fully( outputs[i].get(), data(scratch), n );
+      stats.bytes_written += n;
+    }
+  };
+
+  gcm_tag tag;
+  for (;;)
+  {
+    const auto got = [&]
+    {
+      const auto timed = stats.time( stats.read_wait );
+      return read_fully( in.get(), data(ring)+held, buffer_size );
+    }();
+    stats.bytes_read += got;
+    const auto avail = held + got;
+    if ( avail < tag_size )
+    {
+      std::cerr << "error: input too short ("<< stats.bytes_read <<" bytes)\n";
+      throw see_stderr{};
+    }
+    const auto body = avail - tag_size;
+    source.update( data(ring), data(ring), body );
+    fan_out( data(ring), body );
+    if ( got != buffer_size )  // eof
+    {
+      std::copy_n( data(ring)+body, tag_size, data(tag) );
+      break;
+    }
+    std::copy_n( data(ring)+body, tag_size, data(ring) );
+    held = tag_size;
+  }
+
+  if ( opts.verbose )
+    log_result( decrypt, source.total_processed(), tag );
+  const auto authentic = source.finalize_dec( tag );
+  if ( authentic )
+  {
+    for ( std::size_t i = 0; i != size(targets); ++i )
+    {
+      const auto new_tag = ciphers[i].finalize_enc();
+      if ( opts.verbose )
+        log_result( encrypt, ciphers[i].total_processed(), new_tag );
+      const auto timed = stats.time( stats.write_wait );
+      write_fully( outputs[i].get(), data(new_tag), tag_size );
+      outputs[i].sync();
+      stats.bytes_written += tag_size;
+    }
+    // each rename is atomic, if not all of them together; none is done
+    // before every output is complete and on disk
+    for ( auto &o : outputs )
+      o.commit();
+  }
+
+  for ( const auto &c : ciphers )
+  {
+    const auto &s = c.statistics();
+    stats.cipher_calls += s.cipher_calls;
+    stats.crypto.wall_ns += s.crypto.wall_ns;
+    stats.crypto.cpu_ns  += s.crypto.cpu_ns;
+  }
+  emit_stats( stats, opts, decrypt, in_path, authentic );
+  return authentic;
+}
@@ -0,0 +1,71 @@
+
+#ifndef UNAESGCM_H
+#define UNAESGCM_H
+
+/* Incremental AES-GCM de-/encryption with caller-owned buffers, as exported
+ * by libunaesgcm. Nothing is allocated, logged or thrown past
+ * unaesgcm_new(); every other function reports through its return value.
+ *
+ * Usage: unaesgcm_new, then per message unaesgcm_init, any number of
+ * unaesgcm_update calls and unaesgcm_finalize, then unaesgcm_free. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(UNAESGCM_BUILDING) && defined(__GNUC__)
+#define UNAESGCM_API __attribute__((visibility("default")))
+#else
+#define UNAESGCM_API
+#endif
+
+#define UNAESGCM_TAG_SIZE 16
+
+enum unaesgcm_status
+{
+  UNAESGCM_OK               =  0,
+  UNAESGCM_AUTH_FAILED      =  1,  /* finalize: the tag doesn't match */
+  UNAESGCM_UNAUTHENTICATED  =  2,  /* finalize: a range can't be checked */
+  UNAESGCM_BAD_ARGUMENT     = -1,  /* null pointer, bad key or IV size */
+  UNAESGCM_BUFFER_TOO_SMALL = -2,  /* update: out_cap < in_len */
+  UNAESGCM_BAD_STATE        = -3,  /* not initialized, or already finalized */
+  UNAESGCM_CRYPTO_FAILED    = -4,  /* libcrypto reported an error */
+  UNAESGCM_OUT_OF_MEMORY    = -5
+};
+
+typedef struct unaesgcm_ctx unaesgcm_ctx;
+
+/* returns NULL when out of memory */
+UNAESGCM_API unaesgcm_ctx *unaesgcm_new( void );
+UNAESGCM_API void unaesgcm_free( unaesgcm_ctx * );
+
+/* key_len is 16, 24 or 32 bytes; iv_len is anything but 0 */
+UNAESGCM_API int unaesgcm_init( unaesgcm_ctx *, int decrypt,
+  const uint8_t *key, size_t key_len, const uint8_t *iv, size_t iv_len );
+
+/* Prepares for decryption of the ciphertext from byte offset on, which can
+ * NOT be authenticated: finalize will report UNAESGCM_UNAUTHENTICATED. */
+UNAESGCM_API int unaesgcm_init_range( unaesgcm_ctx *,
+  const uint8_t *key, size_t key_len, const uint8_t *iv, size_t iv_len,
+  uint64_t offset );
+
+/* Writes exactly in_len bytes to out, which may equal in but not otherwise
+ * overlap it. When decrypting, in must not include the tag. */
+UNAESGCM_API int unaesgcm_update( unaesgcm_ctx *,
+  const uint8_t *in, size_t in_len,
+  uint8_t *out, size_t out_cap, size_t *out_len );
+
+/* Encrypting, stores the tag; decrypting, checks it. */
+UNAESGCM_API int unaesgcm_finalize( unaesgcm_ctx *,
+  uint8_t tag[UNAESGCM_TAG_SIZE] );
+
+UNAESGCM_API const char *unaesgcm_strerror( int status );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+#include "posixio.hpp"
+#include "curlio.hpp"
+#include <openssl/rand.h>
+#include <algorithm>
+#include <exception>
+#include <sys/stat.h>
+
+namespace
+{
+
+// The request body: the input, read and encrypted in place in libcurl's own
+// buffer whenever it asks for more, and then the tag. The time libcurl spends
+// in between, sending, counts as waiting for output.
+struct upload_body
+{
+  gcm_cipher &cipher;
+  const int in;
+  const char *const in_path;
+  std::uint64_t left;
+  std::optional<gcm_tag> tag = {};
+  std::size_t tag_sent = 0;
+  std::optional<engine_stats::timer> sending = {};
+  std::exception_ptr failure = {};
+
+  std::size_t read( byte *const buf, const std::size_t n )
+  {
+    auto &stats = cipher.statistics();
+    if ( left )
+    {
+      const auto k = static_cast<std::size_t>(
+        std::min<std::uint64_t>(n, left) );
+      {
+        const auto timed = stats.time( stats.read_wait );
+        if ( read_fully(in, buf, k) != k )
+        {
+          std::cerr << "error: '"<< in_path <<"' shrank while uploading\n";
+          throw io_error{};
+        }
+      }
+      stats.bytes_read += k;
+      cipher.update( buf, buf, k );
+      left -= k;
+      stats.bytes_written += k;
+      return k;
+    }
+    if ( not tag )
+      tag = cipher.finalize_enc();
+    const auto k = std::min( n, tag_size-tag_sent );
+    std::copy_n( std::data(*tag)+tag_sent, k, buf );
+    tag_sent += k;
+    stats.bytes_written += k;
+    return k;
+  }
+
+  static std::size_t on_read( char *const p, const std::size_t size,
+    const std::size_t n, void *const self )
+  {
+    auto &b = *static_cast<upload_body *>(self);
+    b.sending.reset();
+    try
+    {
+      const auto k = b.read( reinterpret_cast<byte *>(p), size*n );
+      auto &stats = b.cipher.statistics();
+      b.sending.emplace( stats.timing ? &stats.write_wait : nullptr );
+      return k;
+    }
+    catch ( ... )
+    {
+      b.failure = std::current_exception();
+      return CURL_READFUNC_ABORT;
+    }
+  }
+};
+
+}
+
+std::string aesgcm_upload( const char *const in_path, const char *const url,
+  const engine_options &opts )
+{
+  using std::data; using std::size;
+
+  const auto u = std::string_view{url};
+  const auto scheme_end = u.find( "://" );
+  if ( scheme_end == u.npos )
+  {
+    std::cerr << "error: not a URL: "<< url <<'\n';
+    throw see_stderr{};
+  }
+
+  // the IV size most clients expect, and the widest key
+  std::array<byte,12> iv;
+  std::array<byte,bits<256>> key;
+  if ( RAND_bytes(data(iv), size(iv)) != 1 or
+       RAND_bytes(data(key), size(key)) != 1 )
+  {
+    std::cerr << "error: RAND_bytes failed\n";
+    throw see_stderr{};
+  }
+  const std::vector<byte> iv_v( std::begin(iv), std::end(iv) );
+  gcm_cipher cipher{encrypt, iv_v, key, opts.cipher};
+  cipher.hash( opts.hashes );
+  auto &stats = cipher.statistics();
+  stats.backend = "upload";
+  stats.timing = opts.stats_fd >= 0;
+
+  // the length goes up front, so the input has to have one
+  const unique_fd in{ ::open(in_path, O_RDONLY|O_CLOEXEC) };
+  if ( not in )
+    sys_failed( "open", in_path );
+  struct stat st;
+  if ( ::fstat(in.get(), &st) or not S_ISREG(st.st_mode) )
+  {
+    std::cerr << "error: '"<< in_path <<"' is not a regular file\n";
+    throw see_stderr{};
+  }
+  ::posix_fadvise( in.get(), 0, 0, POSIX_FADV_SEQUENTIAL );
+  const auto body_size = static_cast<std::uint64_t>(st.st_size);
+
+  // libcurl's upload buffer, which is what's encrypted at a time, is bounded
+  const auto chunk = std::clamp( checked_buffer_size(opts),
+    std::size_t{CURL_MAX_WRITE_SIZE}, std::size_t{2} << 20 );
+  stats.chunk_size = chunk;
+
+  upload_body body{ cipher, in.get(), in_path, body_size };
+  char error[CURL_ERROR_SIZE] = {};
+  const auto put = new_easy( url, error );
+  // no waiting for "100 Continue", as upload slots are granted beforehand
+  const curl_headers headers{ curl_slist_append(nullptr, "Expect:") };
+  set( put.get(), CURLOPT_UPLOAD, 1L );
+  set( put.get(), CURLOPT_INFILESIZE_LARGE,
+    static_cast<curl_off_t>(body_size + tag_size) );
+  set( put.get(), CURLOPT_UPLOAD_BUFFERSIZE, static_cast<long>(chunk) );
+  set( put.get(), CURLOPT_READFUNCTION, &upload_body::on_read );
+  set( put.get(), CURLOPT_READDATA, &body );
+  set( put.get(), CURLOPT_HTTPHEADER, headers.get() );
+  const auto res = curl_easy_perform( put.get() );
+  body.sending.reset();
+  if ( body.failure )
+    std::rethrow_exception( body.failure );
+  if ( res != CURLE_OK )
+    curl_failed( "uploading to "+ std::string{url},
+      *error ? error : curl_easy_strerror(res) );
+  if ( opts.verbose )
+  {
+    log_result( encrypt, body_size, *body.tag );
+    cipher.log_hashes();
+  }
+  emit_stats( stats, opts, encrypt, in_path );
+
+  // the scheme that says how to open it, and the secrets that never reach
+  // the server
+  return "aesgcm"+ std::string{u.substr(scheme_end, u.find('#')-scheme_end)}
+    +"#"+ to_hex(iv) + to_hex(key);
+}
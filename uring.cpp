@@ -0,0 +1,405 @@
+#include "posixio.hpp"
+#include "alignedbuf.hpp"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+namespace
+{
+  // just enough of an io_uring, on the bare system calls
+  class ring
+  {
+    unique_fd fd;
+    mapping sq_map, cq_map, sqe_map;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    unsigned prepared = 0;
+
+    template<typename T>
+    static T *at( const mapping &m, const unsigned offset )
+    { return reinterpret_cast<T *>( m.data()+offset ); }
+
+    ring( unique_fd ring_fd, const io_uring_params &p )
+      : fd{std::move(ring_fd)}
+    {
+      const auto single = p.features & IORING_FEAT_SINGLE_MMAP;
+      const auto sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+      const auto cq_size = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+      sq_map = mapping{ fd.get(), single ? std::max(sq_size, cq_size) : sq_size,
+        PROT_READ|PROT_WRITE, "io_uring", IORING_OFF_SQ_RING };
+      if ( not single )
+        cq_map = mapping{ fd.get(), cq_size,
+          PROT_READ|PROT_WRITE, "io_uring", IORING_OFF_CQ_RING };
+      const auto &cq = single ? sq_map : cq_map;
+      sqe_map = mapping{ fd.get(), p.sq_entries*sizeof(io_uring_sqe),
+        PROT_READ|PROT_WRITE, "io_uring", IORING_OFF_SQES };
+
+      sq_head  = at<unsigned>( sq_map, p.sq_off.head );
+      sq_tail  = at<unsigned>( sq_map, p.sq_off.tail );
+      sq_mask  = at<unsigned>( sq_map, p.sq_off.ring_mask );
+      sq_array = at<unsigned>( sq_map, p.sq_off.array );
+      cq_head  = at<unsigned>( cq, p.cq_off.head );
+      cq_tail  = at<unsigned>( cq, p.cq_off.tail );
+      cq_mask  = at<unsigned>( cq, p.cq_off.ring_mask );
+      cqes     = at<io_uring_cqe>( cq, p.cq_off.cqes );
+      sqes     = at<io_uring_sqe>( sqe_map, 0 );
+    }
+
+  public:
+    // nothing if the kernel lacks io_uring, or doesn't let us use it
+    static std::optional<ring> open( const unsigned entries )
+    {
+      io_uring_params p{};
+      const auto r = ::syscall( __NR_io_uring_setup, entries, &p );
+      if ( r < 0 )
+        return {};
+      return ring{ unique_fd{static_cast<int>(r)}, p };
+    }
+
+    bool register_buffers( const iovec *const iov, const unsigned n )
+    {
+      return ::syscall( __NR_io_uring_register, fd.get(),
+        IORING_REGISTER_BUFFERS, iov, n ) == 0;
+    }
+
+    // queues a read or write; there must be room, which the caller ensures
+    // by never having more in flight than the ring has entries
+    void prepare( const __u8 opcode, const int file, const void *const addr,
+      const std::size_t len, const std::uint64_t offset,
+      const std::uint64_t user_data, const int buf_index = -1 )
+    {
+      const auto idx = (*sq_tail + prepared) & *sq_mask;
+      auto &sqe = sqes[idx];
+      sqe = {};
+      sqe.opcode    = opcode;
+      sqe.fd        = file;
+      sqe.addr      = reinterpret_cast<std::uintptr_t>(addr);
+      sqe.len       = static_cast<__u32>(len);
+      sqe.off       = offset;
+      sqe.user_data = user_data;
+      if ( buf_index >= 0 )
+        sqe.buf_index = static_cast<__u16>(buf_index);
+      sq_array[idx] = idx;
+      ++prepared;
+    }
+
+    // submits all prepared, and waits for at least one completion
+    void submit_and_wait()
+    {
+      const auto tail = *sq_tail + prepared;
+      std::atomic_ref{*sq_tail}.store( tail, std::memory_order_release );
+      prepared = 0;
+      for ( ;; )
+      {
+        // whatever the kernel hasn't consumed yet, also after an EINTR
+        const auto unsubmitted =
+          tail - std::atomic_ref{*sq_head}.load(std::memory_order_acquire);
+        if ( ::syscall( __NR_io_uring_enter, fd.get(), unsubmitted, 1u,
+               IORING_ENTER_GETEVENTS, nullptr, 0 ) >= 0 )
+          return;
+        if ( errno != EINTR )
+          sys_failed( "io_uring_enter" );
+      }
+    }
+
+    template<typename F>
+    void reap( F &&f )
+    {
+      auto head = *cq_head;
+      const auto tail =
+        std::atomic_ref{*cq_tail}.load( std::memory_order_acquire );
+      for ( ; head != tail; ++head )
+      {
+        const auto cqe = cqes[head & *cq_mask];
+        std::atomic_ref{*cq_head}.store( head+1, std::memory_order_release );
+        f( cqe );
+      }
+    }
+  };
+}
+
+std::optional<bool> aesgcm_uring( gcm_cipher &cipher,
+  const int in, const char *const in_path, const char *const out_path,
+  const engine_options &opts )
+{
+  using std::data;
+
+  constexpr unsigned depth = 8;
+  const auto buffer_size = checked_buffer_size(opts);
+
+  // Each buffer has room for a carried-over lookbehind in front of the data
+  // read into it, and for the tag behind it. All are registered with the
+  // kernel if it lets us, saving it the page pinning on every transfer.
+  // They outlive the ring, so that nothing still in flight when an error
+  // unwinds the stack lands in freed memory.
+  const auto stride = (tag_size + buffer_size + tag_size + 63) / 64 * 64;
+  const alignedbuf<byte> mem( depth*stride );
+  auto r = ring::open( 2*depth );
+  if ( not r )
+    return {};
+
+  // stdout as it is, at its position and appending if it does, rather than
+  // reopened and truncated by name
+  const unique_fd out_fd{ out_path == std::string_view{"/dev/stdout"} ?
+    ::fcntl( STDOUT_FILENO, F_DUPFD_CLOEXEC, 0 ) :
+    ::open( out_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0666 ) };
+  if ( not out_fd )
+    sys_failed( "open", out_path );
+  const auto out = out_fd.get();
+
+  const auto decrypt = cipher.decrypting();
+  auto &stats = cipher.statistics();
+  stats.backend = "io_uring";
+  stats.chunk_size = buffer_size;
+
+  std::array<iovec,depth> iov;
+  for ( auto i = 0u; i < depth; ++i )
+    iov[i] = { data(mem)+i*stride, stride };
+  const auto fixed = r->register_buffers( data(iov), depth );
+  const auto buf_index = [&]( const unsigned i )
+  { return fixed ? static_cast<int>(i) : -1; };
+
+  // Regular files are transferred at explicit offsets, several at a time.
+  // Pipes and the like are read and written one transfer at a time, since
+  // concurrent ones on them may complete out of order.
+  struct stat in_st, out_st;
+  if ( ::fstat(in, &in_st) )
+    sys_failed( "stat", in_path );
+  if ( ::fstat(out, &out_st) )
+    sys_failed( "stat", out_path );
+  // appending ignores offsets, so the writes go one at a time there, too
+  const auto in_seekable  = S_ISREG(in_st.st_mode);
+  const auto out_seekable = S_ISREG(out_st.st_mode) and
+    not (::fcntl(out, F_GETFL) & O_APPEND);
+  const auto in_base = in_seekable ? ::lseek(in, 0, SEEK_CUR) : 0;
+  auto out_pos = out_seekable ? ::lseek(out, 0, SEEK_CUR) : 0;
+  if ( in_base < 0 or out_pos < 0 )
+    sys_failed( "lseek" );
+  const auto in_size = in_seekable ?
+    static_cast<std::uint64_t>( std::max<off_t>(in_st.st_size - in_base, 0) ) :
+    0;
+  if ( in_seekable and out_seekable )
+    preallocate( out, static_cast<std::uint64_t>(out_pos) + (not decrypt ?
+      in_size + tag_size : in_size - std::min<std::uint64_t>(in_size, tag_size)),
+      out_path );
+  constexpr auto stream_offset = ~std::uint64_t{0};
+
+  enum class state { free, reading, read, writing };
+  struct slot
+  {
+    state st = state::free;
+    std::uint64_t seq = 0;
+    std::size_t got = 0, want = 0;
+    bool last = false;
+    byte *wbuf = nullptr;
+    std::size_t wlen = 0;
+    std::uint64_t woff = 0;
+  };
+  std::array<slot,depth> slots;
+  const auto data_of = [&]( const unsigned i )
+  { return data(mem) + i*stride + tag_size; };
+
+  constexpr std::uint64_t read_kind = 0, write_kind = 1ull << 32;
+  const auto submit_read = [&]( const unsigned i )
+  {
+    auto &s = slots[i];
+    r->prepare( fixed ? IORING_OP_READ_FIXED : IORING_OP_READ, in,
+      data_of(i)+s.got, s.want-s.got, in_seekable ?
+        static_cast<std::uint64_t>(in_base) + s.seq*buffer_size + s.got :
+        stream_offset,
+      read_kind | i, buf_index(i) );
+  };
+  const auto submit_write = [&]( const unsigned i )
+  {
+    auto &s = slots[i];
+    r->prepare( fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, out,
+      s.wbuf, s.wlen, out_seekable ? s.woff : stream_offset,
+      write_kind | i, buf_index(i) );
+  };
+
+  std::uint64_t next_read = 0, next_crypt = 0, total_read = 0;
+  bool reads_done = false, crypt_done = false, stream_reading = false;
+  unsigned reads_in_flight = 0, writes_in_flight = 0;
+  std::deque<unsigned> write_queue;
+
+  std::array<byte,tag_size> carry;
+  std::size_t held = 0;
+  gcm_tag tag;
+  bool authentic = true;
+
+  const auto crypt = [&]( const unsigned i )
+  {
+    auto &s = slots[i];
+    const auto d = data_of(i);
+    if ( not decrypt )
+    {
+      cipher.update( d, d, s.got );
+      s.wbuf = d;
+      s.wlen = s.got;
+      if ( s.last )
+      {
+        tag = cipher.finalize_enc();
+        if ( opts.verbose )
+          log_result( decrypt, cipher.total_processed(), tag );
+        std::copy( std::begin(tag), std::end(tag), d+s.got );
+        s.wlen += tag_size;
+      }
+      return;
+    }
+    // the lookbehind goes in front of the new data, and the last tag_size
+    // bytes of both are held back in turn
+    const auto whole = d - held;
+    std::copy_n( data(carry), held, whole );
+    const auto n = held + s.got;
+    if ( s.last and n < tag_size )
+    {
+      std::cerr << "error: input too short ("<< total_read <<" bytes)\n";
+      throw see_stderr{};
+    }
+    const auto body = n < tag_size ? 0 : n - tag_size;
+    held = n - body;
+    std::copy_n( whole+body, held, s.last ? data(tag) : data(carry) );
+    cipher.update( whole, whole, body );
+    s.wbuf = whole;
+    s.wlen = body;
+    if ( s.last )
+    {
+      if ( opts.verbose )
+        log_result( decrypt, cipher.total_processed(), tag );
+      authentic = cipher.finalize_dec( tag );
+    }
+  };
+
+  const auto on_completion = [&]( const io_uring_cqe &cqe )
+  {
+    const auto i = static_cast<unsigned>( cqe.user_data & 0xffffffff );
+    auto &s = slots[i];
+    const auto is_read = (cqe.user_data & write_kind) == 0;
+    if ( cqe.res == -EINTR or cqe.res == -EAGAIN )
+      return is_read ? submit_read(i) : submit_write(i);
+    if ( cqe.res < 0 )
+    {
+      errno = -cqe.res;
+      sys_failed( is_read ? "read" : "write", is_read ? in_path : out_path );
+    }
+    const auto n = static_cast<std::size_t>(cqe.res);
+    if ( is_read )
+    {
+      --reads_in_flight;
+      total_read += n;
+      stats.bytes_read += n;
+      s.got += n;
+      if ( in_seekable and n and s.got != s.want )
+      {
+        ++reads_in_flight;
+        return submit_read(i);
+      }
+      if ( in_seekable and not n )
+      {
+        std::cerr << "error: '"<< in_path <<"' shrank while being read\n";
+        throw io_error{};
+      }
+      if ( not in_seekable )
+      {
+        stream_reading = false;
+        if ( not n )
+          s.last = reads_done = true;
+      }
+      s.st = state::read;
+      return;
+    }
+    stats.bytes_written += n;
+    s.wbuf += n;
+    s.wlen -= n;
+    s.woff += n;
+    if ( s.wlen )
+      return submit_write(i);
+    s.st = state::free;
+    --writes_in_flight;
+  };
+
+  for ( ;; )
+  {
+    // reads, as far as there are buffers for them
+    for ( unsigned i; not reads_done and
+            slots[i = next_read % depth].st == state::free and
+            not stream_reading; ++next_read )
+    {
+      auto &s = slots[i];
+      s = { state::reading, next_read };
+      if ( in_seekable )
+      {
+        const auto start = next_read*buffer_size;
+        s.want = static_cast<std::size_t>(
+          std::min<std::uint64_t>( buffer_size, in_size-start ) );
+        s.last = reads_done = start + s.want == in_size;
+        if ( not s.want )
+        {
+          s.st = state::read;
+          continue;
+        }
+      }
+      else
+      {
+        s.want = buffer_size;
+        stream_reading = true;
+      }
+      ++reads_in_flight;
+      submit_read( i );
+    }
+
+    // de-/encryption, in order
+    for ( unsigned i; not crypt_done and
+            slots[i = next_crypt % depth].st == state::read and
+            slots[i].seq == next_crypt; ++next_crypt )
+    {
+      crypt( i );
+      crypt_done = slots[i].last;
+      slots[i].woff = static_cast<std::uint64_t>(out_pos);
+      out_pos += static_cast<off_t>(slots[i].wlen);
+      slots[i].st = state::writing;
+      write_queue.push_back( i );
+    }
+
+    // writes, in order on pipes
+    while ( not write_queue.empty() and
+            (out_seekable or not writes_in_flight) )
+    {
+      const auto i = write_queue.front();
+      write_queue.pop_front();
+      if ( not slots[i].wlen )
+      {
+        slots[i].st = state::free;
+        continue;
+      }
+      ++writes_in_flight;
+      submit_write( i );
+    }
+
+    if ( crypt_done and write_queue.empty() and not writes_in_flight )
+      break;
+    // (with nothing in flight, a buffer was just freed without any I/O)
+    if ( not reads_in_flight and not writes_in_flight )
+      continue;
+    {
+      // waiting for input as long as any is due, else for output
+      const auto timed = stats.time(
+        reads_in_flight ? stats.read_wait : stats.write_wait );
+      r->submit_and_wait();
+    }
+    r->reap( on_completion );
+  }
+
+  // leave the file positions as if read and written the usual way
+  if ( in_seekable )
+    ::lseek( in, in_base + static_cast<off_t>(total_read), SEEK_SET );
+  if ( out_seekable )
+    ::lseek( out, out_pos, SEEK_SET );
+  return authentic;
+}